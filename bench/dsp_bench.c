@@ -0,0 +1,183 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/dsp.h"
+#include "audio/resample.h"
+#include "audio/types.h"
+#include <sndfile.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Compares every mixer kernel variant the CPU supports on buffers cut from
+// the bundled packs. Run from the repository root, or pass audio files.
+
+#define BENCH_FRAMES 4096
+#define BENCH_ROUNDS 2000
+
+static const char *default_files[] = {
+    "soundpacks/keyboard/eg-oreo/oreo.ogg",
+    "soundpacks/keyboard/banana-split-lubed/banana-l-1.wav",
+    "soundpacks/keyboard/holy-pandas/GENERIC_R0.mp3",
+    "soundpacks/mouse/wooden/wooden.mp3",
+};
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Read up to BENCH_FRAMES frames of the first two channels, looping short
+// files so every buffer has the same length
+static int load_buffer(const char *path, short *out, int *channels,
+                       int *samplerate) {
+  SF_INFO info = {0};
+  SNDFILE *sf = sf_open(path, SFM_READ, &info);
+  if (!sf) {
+    fprintf(stderr, "Skipping %s: %s\n", path, sf_strerror(NULL));
+    return 0;
+  }
+  short *frame = malloc(info.channels * sizeof(short));
+  int copied = 0;
+  int used = info.channels > 2 ? 2 : info.channels;
+  while (copied < BENCH_FRAMES) {
+    if (sf_readf_short(sf, frame, 1) != 1) {
+      if (copied == 0 || sf_seek(sf, 0, SEEK_SET) < 0)
+        break;
+      continue;
+    }
+    memcpy(out + copied * used, frame, used * sizeof(short));
+    copied++;
+  }
+  free(frame);
+  sf_close(sf);
+  *channels = used;
+  *samplerate = info.samplerate;
+  return copied == BENCH_FRAMES;
+}
+
+static void bench_file(const char *path, const DspKernels *variants,
+                       int count) {
+  static short src[BENCH_FRAMES * 2];
+  static float accum[BENCH_FRAMES * 2];
+  static float reference[BENCH_FRAMES * 2];
+  static float reference_mono[BENCH_FRAMES * 2];
+  static short out[BENCH_FRAMES * 2];
+  static short reference_out[BENCH_FRAMES * 2];
+  static short reference_gain[BENCH_FRAMES * 2];
+  static short resampled[BENCH_FRAMES * 4 * 2];
+  static short reference_resampled[BENCH_FRAMES * 4 * 2];
+  static float taps[32];
+  static float reference_dot[BENCH_FRAMES];
+  int channels, samplerate;
+  if (!load_buffer(path, src, &channels, &samplerate))
+    return;
+  // Engine-rate files are timed as if they were 44.1 kHz
+  if (samplerate == ENGINE_SAMPLE_RATE)
+    samplerate = 44100;
+  long resampled_frames = resample_frames(BENCH_FRAMES, samplerate);
+  if (resampled_frames > BENCH_FRAMES * 4)
+    samplerate = ENGINE_SAMPLE_RATE / 4;
+  for (int i = 0; i < 32; i++)
+    taps[i] = 1.0f / (i + 1);
+  int samples = BENCH_FRAMES * channels;
+  printf("\n%s (%d ch, %d frames)\n", path, channels, BENCH_FRAMES);
+  printf("%-8s %-16s %10s %8s %s\n", "variant", "kernel", "ns/frame", "speedup",
+         "check");
+  double scalar_ns[6] = {0};
+  for (int v = 0; v < count; v++) {
+    const DspKernels *k = &variants[v];
+    double ns[6];
+    int ok[6];
+    double start = now_ns();
+    memset(accum, 0, sizeof(accum));
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      if (channels == 1)
+        k->accumulate_mono(accum, src, BENCH_FRAMES, 0.5f);
+      else
+        k->accumulate(accum, src, samples, 0.5f);
+    }
+    ns[0] = (now_ns() - start) / BENCH_ROUNDS / BENCH_FRAMES;
+    if (v == 0)
+      memcpy(reference, accum, sizeof(accum));
+    ok[0] = memcmp(reference, accum, sizeof(accum)) == 0;
+
+    start = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+      k->to_s16(out, accum, BENCH_FRAMES * 2);
+    ns[1] = (now_ns() - start) / BENCH_ROUNDS / BENCH_FRAMES;
+    if (v == 0)
+      memcpy(reference_out, out, sizeof(out));
+    ok[1] = memcmp(reference_out, out, sizeof(out)) == 0;
+
+    start = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+      k->gain_s16(out, src, samples, 0.37f);
+    ns[2] = (now_ns() - start) / BENCH_ROUNDS / BENCH_FRAMES;
+    if (v == 0)
+      memcpy(reference_gain, out, sizeof(out));
+    ok[2] = memcmp(reference_gain, out, sizeof(out)) == 0;
+
+    memset(accum, 0, sizeof(accum));
+    start = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+      k->accumulate_mono(accum, src, BENCH_FRAMES, 0.5f);
+    ns[3] = (now_ns() - start) / BENCH_ROUNDS / BENCH_FRAMES;
+    if (v == 0)
+      memcpy(reference_mono, accum, sizeof(accum));
+    ok[3] = memcmp(reference_mono, accum, sizeof(accum)) == 0;
+
+    // The 32-tap filter the resampler runs per output sample
+    static float dots[BENCH_FRAMES];
+    for (int i = 0; i < BENCH_FRAMES - 32; i++)
+      accum[i] = src[i];
+    start = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS / 8; r++) {
+      for (int i = 0; i < BENCH_FRAMES - 32; i++)
+        dots[i] = k->dot(taps, accum + i, 32);
+    }
+    ns[4] = (now_ns() - start) / (BENCH_ROUNDS / 8) / BENCH_FRAMES;
+    if (v == 0)
+      memcpy(reference_dot, dots, sizeof(dots));
+    ok[4] = memcmp(reference_dot, dots, sizeof(dots)) == 0;
+
+    g_dsp = *k;
+    memset(resampled, 0, sizeof(resampled));
+    start = now_ns();
+    for (int r = 0; r < BENCH_ROUNDS / 40; r++)
+      resample_to_engine(resampled, src, BENCH_FRAMES, channels, samplerate);
+    ns[5] = (now_ns() - start) / (BENCH_ROUNDS / 40) / BENCH_FRAMES;
+    if (v == 0)
+      memcpy(reference_resampled, resampled, sizeof(resampled));
+    ok[5] = memcmp(reference_resampled, resampled, sizeof(resampled)) == 0;
+
+    static const char *names[6] = {"accumulate", "to_s16", "gain_s16",
+                                   "mono_upmix", "dot32",  "resample"};
+    for (int i = 0; i < 6; i++) {
+      if (v == 0)
+        scalar_ns[i] = ns[i];
+      printf("%-8s %-16s %10.3f %7.2fx %s\n", k->name, names[i], ns[i],
+             scalar_ns[i] / ns[i], ok[i] ? "ok" : "MISMATCH");
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int count;
+  const DspKernels *variants = dsp_variants(&count);
+  dsp_init();
+  printf("Kernel variants on this CPU: %d (dispatch picks %s)\n", count,
+         g_dsp.name);
+  printf("resample converts each buffer to %d Hz; dot32 is one filter tap "
+         "set\n",
+         ENGINE_SAMPLE_RATE);
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++)
+      bench_file(argv[i], variants, count);
+  } else {
+    for (size_t i = 0; i < sizeof(default_files) / sizeof(default_files[0]);
+         i++)
+      bench_file(default_files[i], variants, count);
+  }
+  return 0;
+}
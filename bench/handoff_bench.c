@@ -0,0 +1,208 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/dsp.h"
+#include "audio/event_reader.h"
+#include "audio/latency.h"
+#include "audio/mixer.h"
+#include "audio/pack.h"
+#include "audio/playback.h"
+#include "audio/settings.h"
+#include "common/event_record.h"
+#include "common/utils.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// How long input events take to reach the playback thread in the two
+// process layouts, through the shipped handoff code and measured by the
+// engine's own latency histograms:
+//
+//   two-process     records are written down a pipe as vbx-input writes
+//                   them, then read and queued by the EventReader calls of
+//                   vbx-audio's main loop
+//   single-process  a thread hands them to queue_event_records(), as the
+//                   capture thread of `vbx-audio --capture-input` does
+//
+// The engine runs on the null backend with a bundled pack, so run from the
+// repository root. Each layout runs in a child process of its own, so the
+// histograms stay apart. Events are paced like fast typing, so every one
+// finds the playback thread asleep. Pass the number of events to send; the
+// default is 5000.
+
+// Defined by vbx-audio's main.c
+int g_keyboard_enabled = 1;
+int g_mouse_enabled = 1;
+
+#define DEFAULT_EVENTS 5000
+#define EVENT_SPACING_NS 1000000L
+#define BENCH_PACK "soundpacks/keyboard/banana-split-lubed/config.json"
+#define BENCH_KEY 30
+
+static const LatencyStage handoff_stages[] = {STAGE_RECEIVE, STAGE_PARSE,
+                                              STAGE_QUEUE};
+
+static void pace(void) {
+  struct timespec ts = {0, EVENT_SPACING_NS};
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    ;
+}
+
+// A key press stamped as vbx-input stamps it just before writing
+static void make_record(EventRecord *r) {
+  memset(r, 0, sizeof(*r));
+  r->magic = EVENT_RECORD_MAGIC;
+  r->version = EVENT_RECORD_VERSION;
+  r->device = EVENT_DEVICE_KEYBOARD;
+  r->pressed = 1;
+  r->code = BENCH_KEY;
+  r->time_us = r->sent_us = latency_now_us();
+}
+
+static void *produce(void *arg) {
+  int events = *(int *)arg;
+  EventRecord r;
+  for (int i = 0; i < events; i++) {
+    pace();
+    make_record(&r);
+    queue_event_records(&r, 1, NULL);
+  }
+  return NULL;
+}
+
+static int run_single_process(int events) {
+  pthread_t producer;
+  if (pthread_create(&producer, NULL, produce, &events) != 0)
+    return -1;
+  pthread_join(producer, NULL);
+  return 0;
+}
+
+static int run_two_process(int events) {
+  int pipefd[2];
+  if (pipe(pipefd) != 0) {
+    perror("pipe");
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    close(pipefd[0]);
+    EventRecord r;
+    for (int i = 0; i < events; i++) {
+      pace();
+      make_record(&r);
+      if (write(pipefd[1], &r, sizeof(r)) != (ssize_t)sizeof(r))
+        _exit(1);
+    }
+    _exit(0);
+  }
+  close(pipefd[1]);
+  static EventReader reader;
+  event_reader_init(&reader);
+  while (1) {
+    fd_set readfds;
+    struct timeval timeout = {1, 0};
+    FD_ZERO(&readfds);
+    FD_SET(pipefd[0], &readfds);
+    int ready = select(pipefd[0] + 1, &readfds, NULL, NULL, &timeout);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready <= 0)
+      break;
+    ssize_t n = event_reader_fill(&reader, pipefd[0]);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    event_reader_queue(&reader);
+  }
+  close(pipefd[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int bench(const char *name, int (*run)(int), int events) {
+  safe_strncpy(g_audio_settings.backend, "null",
+               sizeof(g_audio_settings.backend));
+  g_audio_settings.cache = 0;
+  SoundPack *pack = load_sound_pack(BENCH_PACK);
+  if (!pack) {
+    fprintf(stderr, "Could not load %s; run from the repository root\n",
+            BENCH_PACK);
+    return -1;
+  }
+  if (mixer_init() != 0 || start_playback_thread(pack, NULL) != 0) {
+    sound_pack_free(pack);
+    return -1;
+  }
+  int rc = run(events);
+  // Let the last voices start, so their events are recorded
+  struct timespec settle = {0, 100000000L};
+  nanosleep(&settle, NULL);
+  stop_playback_thread();
+  mixer_shutdown();
+  sound_pack_free(pack);
+  if (rc != 0) {
+    fprintf(stderr, "The %s run failed\n", name);
+    return -1;
+  }
+  double mean = 0.0;
+  for (size_t i = 0; i < sizeof(handoff_stages) / sizeof(*handoff_stages);
+       i++) {
+    LatencySummary sum;
+    latency_get_summary(handoff_stages[i], &sum);
+    mean += sum.mean_us;
+    printf("%-15s %-8s %8llu %9.1f %9llu %9llu %9llu %9llu\n", name,
+           latency_stage_name(handoff_stages[i]),
+           (unsigned long long)sum.count, sum.mean_us,
+           (unsigned long long)sum.p50_us, (unsigned long long)sum.p90_us,
+           (unsigned long long)sum.p99_us, (unsigned long long)sum.max_us);
+  }
+  printf("%-15s %-8s %8s %9.1f\n", name, "sum", "", mean);
+  return 0;
+}
+
+// In a child, so each layout starts with empty histograms
+static int bench_in_child(const char *name, int (*run)(int), int events) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    int rc = bench(name, run, events);
+    fflush(stdout);
+    _exit(rc == 0 ? 0 : 1);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  int events = argc > 1 ? atoi(argv[1]) : DEFAULT_EVENTS;
+  if (events < 1) {
+    fprintf(stderr, "Usage: %s [events]\n", argv[0]);
+    return 1;
+  }
+  dsp_init();
+  printf("Event handoff to the playback thread, us, %d events %ld us "
+         "apart\n",
+         events, EVENT_SPACING_NS / 1000);
+  printf("%-15s %-8s %8s %9s %9s %9s %9s %9s\n", "layout", "stage", "count",
+         "mean", "p50", "p90", "p99", "max");
+  if (bench_in_child("two-process", run_two_process, events) != 0 ||
+      bench_in_child("single-process", run_single_process, events) != 0)
+    return 1;
+  return 0;
+}
@@ -10,6 +10,8 @@ typedef struct {
   int daemon_flag;
   int stop_flag;
   int list_flag;
+  int stats_flag;
+  int json_flag; // --stats as JSON
   int verbose;
   int keyboard_mute; // -1 unchanged, 0 unmute, 1 mute
   int mouse_mute;    // -1 unchanged, 0 unmute, 1 mute
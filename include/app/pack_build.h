@@ -0,0 +1,7 @@
+#ifndef VBX_PACK_BUILD_H
+#define VBX_PACK_BUILD_H
+
+// `vbx pack build PACK [-o FILE] [-v]`; argv[0] is "pack"
+int run_pack_command(int argc, char **argv);
+
+#endif // VBX_PACK_BUILD_H
@@ -0,0 +1,9 @@
+#ifndef VBX_STATS_H
+#define VBX_STATS_H
+
+// `vbx --stats [--json]`: print the counters the running vbx-audio
+// publishes, as a table or as one line of JSON. Returns 1 if no engine is
+// running.
+int print_engine_stats(int json);
+
+#endif // VBX_STATS_H
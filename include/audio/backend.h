@@ -0,0 +1,47 @@
+#ifndef VBX_AUDIO_BACKEND_H
+#define VBX_AUDIO_BACKEND_H
+
+#include "audio/settings.h"
+
+// Fills `frames` interleaved engine-format frames
+typedef void (*RenderFn)(short *out, int frames);
+
+// An output device for the mixed engine stream. Pull backends (write ==
+// NULL) call `render` from their own thread whenever the device wants data;
+// for push backends the mixer runs a thread that renders a period and hands
+// it to write(), which blocks to pace the engine in real time.
+typedef struct {
+  const char *name;
+  int (*open)(const AudioSettings *settings, RenderFn render);
+  int (*write)(const short *frames, int count);
+  // Current output latency in microseconds, or -1 if unknown
+  long (*latency_us)(void);
+  unsigned long (*underruns)(void);
+  void (*close)(void);
+} AudioBackend;
+
+extern const AudioBackend pulse_backend;
+#ifdef VBX_WITH_PIPEWIRE
+extern const AudioBackend pipewire_backend;
+#endif
+#ifdef VBX_WITH_ALSA
+extern const AudioBackend alsa_backend;
+#endif
+extern const AudioBackend null_backend;
+extern const AudioBackend wav_backend;
+
+const AudioBackend *find_audio_backend(const char *name);
+void print_audio_backends(void);
+
+// Real-time pacing for sinks without a device clock
+typedef struct {
+  long long next_ns; // CLOCK_MONOTONIC deadline of the next period
+  int started;
+  unsigned long late;
+} BackendClock;
+
+// Sleep until `frames` more frames would have been played. Falling more than
+// a few periods behind resets the clock and counts as an underrun.
+void backend_clock_wait(BackendClock *clock, int frames);
+
+#endif // VBX_AUDIO_BACKEND_H
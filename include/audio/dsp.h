@@ -0,0 +1,29 @@
+#ifndef VBX_AUDIO_DSP_H
+#define VBX_AUDIO_DSP_H
+
+// Sample loop kernels used by the mixer and resampler. Every variant produces
+// the same output as the scalar one; dsp_init() picks the fastest the CPU
+// supports. Call it before decoding any pack, as the resampler uses it too.
+typedef struct {
+  const char *name;
+  // accum[i] += src[i] * gain for `samples` interleaved samples. Returns the
+  // peak magnitude of src, which the mixer uses as the voice level.
+  int (*accumulate)(float *accum, const short *src, int samples, float gain);
+  // Same for a mono source mixed into both channels of a stereo accum
+  int (*accumulate_mono)(float *accum, const short *src, int frames,
+                         float gain);
+  // Round and saturate float samples to S16
+  void (*to_s16)(short *dst, const float *src, int samples);
+  // dst[i] = saturate(src[i] * gain); dst may equal src
+  void (*gain_s16)(short *dst, const short *src, int samples, float gain);
+  // Sum of a[i] * b[i]; n must be a multiple of 8. Used by the resampler.
+  float (*dot)(const float *a, const float *b, int n);
+} DspKernels;
+
+extern DspKernels g_dsp;
+
+void dsp_init(void);
+// All variants runnable on this CPU, scalar first, for benchmarking
+const DspKernels *dsp_variants(int *count);
+
+#endif // VBX_AUDIO_DSP_H
@@ -0,0 +1,44 @@
+#ifndef VBX_AUDIO_EVENT_READER_H
+#define VBX_AUDIO_EVENT_READER_H
+
+#include "audio/latency.h"
+#include "common/event_record.h"
+#include <stddef.h>
+#include <sys/types.h>
+
+// Splits what arrives on the event pipe into events: binary records from
+// vbx-input (common/event_record.h), or JSON lines from `vbx-input --json`
+// or typed in by hand. The pipe is read with read() rather than stdio, so
+// everything a read returns is handled at once and nothing waits in a
+// stdio buffer for the next select() to come round.
+
+#define EVENT_READER_SIZE 8192
+
+typedef struct {
+  char data[EVENT_READER_SIZE];
+  size_t start; // first byte not yet handled
+  size_t used;
+  int warned_version;
+} EventReader;
+
+void event_reader_init(EventReader *r);
+// One read() from fd into the free space: bytes read, 0 at end of file or
+// -1 with errno set
+ssize_t event_reader_fill(EventReader *r, int fd);
+// At end of file: end a last JSON line that had no newline, so
+// event_reader_next() returns it like any other
+void event_reader_finish(EventReader *r);
+// Take the next complete event, skipping malformed ones; returns 0 when
+// only part of one is left. Fills the event and sent times, or 0.
+int event_reader_next(EventReader *r, int *key_code, int *is_pressed,
+                      EventTimes *times);
+// Queue every complete event for the playback thread, stamped as received
+// together now: what vbx-audio does with each read of the pipe
+void event_reader_queue(EventReader *r);
+
+// The in-memory handoff of --capture-input, an InputSink for the capture
+// thread: records go straight onto the event queue, so there is nothing to
+// receive or parse. The capture thread is then the queue's only producer.
+void queue_event_records(EventRecord *records, int count, void *user);
+
+#endif // VBX_AUDIO_EVENT_READER_H
@@ -0,0 +1,23 @@
+#ifndef VBX_AUDIO_INTERN_H
+#define VBX_AUDIO_INTERN_H
+
+#include "audio/types.h"
+#include <stddef.h>
+
+// Decoded sound files interned by a hash of the file's bytes, so a sound is
+// decoded and held once however many keys, paths or packs refer to it.
+// Interned clips live until exit. Used while loading packs, from one thread.
+
+typedef struct {
+  unsigned int paths;  // distinct paths looked up
+  unsigned int clips;  // distinct file contents decoded
+  size_t bytes;        // PCM held by the interned clips
+  size_t bytes_shared; // PCM that decoding every path separately would add
+} InternStats;
+
+// Engine-format clip for the contents of `path`, decoding it the first time
+// those contents are seen, or NULL if the file cannot be decoded
+const AudioClip *intern_clip_file(const char *path);
+void intern_get_stats(InternStats *out);
+
+#endif // VBX_AUDIO_INTERN_H
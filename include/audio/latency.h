@@ -0,0 +1,60 @@
+#ifndef VBX_AUDIO_LATENCY_H
+#define VBX_AUDIO_LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// End-to-end latency of input events, from the kernel's timestamp to the
+// buffer holding their sound reaching the output backend, split into
+// stages. Each stage keeps an HDR-style histogram: exact below 16 us, then
+// 16 linear sub-buckets per power of two, so any value is within 6.25%.
+
+// Where one event was when, in microseconds of CLOCK_MONOTONIC (the clock
+// libinput stamps events with); 0 where unknown, e.g. typed-in test input
+typedef struct {
+  uint64_t event_us;    // key went down, from vbx-input
+  uint64_t sent_us;     // vbx-input wrote the event
+  uint64_t received_us; // vbx-audio read it
+  uint64_t parsed_us;
+  uint64_t dequeued_us; // the playback thread took it off the event queue
+} EventTimes;
+
+typedef enum {
+  STAGE_INPUT,   // libinput event to vbx-input writing it
+  STAGE_RECEIVE, // through the pipe to vbx-audio
+  STAGE_PARSE,
+  STAGE_QUEUE,   // event queue, until the playback thread wakes with it
+  STAGE_VOICE,   // clip lookup and voice queue, to the period starting it
+  STAGE_SUBMIT,  // mixing that period, to handing it to the backend
+  STAGE_OUTPUT,  // backend-reported latency from there to the speaker
+  STAGE_TOTAL,
+  NUM_LATENCY_STAGES
+} LatencyStage;
+
+typedef struct {
+  uint64_t count;
+  double mean_us;
+  uint64_t p50_us;
+  uint64_t p90_us;
+  uint64_t p99_us;
+  uint64_t p999_us;
+  uint64_t max_us;
+} LatencySummary;
+
+uint64_t latency_now_us(void);
+// Last output latency the backend reported; refreshed by the main loop,
+// since asking the backend may lock what the render thread holds
+void latency_set_output_us(long us);
+// Record an event whose voice started in a period begun at voice_us and
+// submitted at submit_us. Render thread only.
+void latency_record(const EventTimes *t, uint64_t voice_us,
+                    uint64_t submit_us);
+const char *latency_stage_name(LatencyStage stage);
+void latency_get_summary(LatencyStage stage, LatencySummary *out);
+// Percentile table, then each stage's non-empty buckets
+void latency_dump(FILE *f);
+// latency_dump() into $XDG_RUNTIME_DIR/vbx-latency-<uid>.txt, written on
+// SIGUSR2; returns -1 if it could not be written
+int latency_dump_file(void);
+
+#endif // VBX_AUDIO_LATENCY_H
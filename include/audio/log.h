@@ -0,0 +1,34 @@
+#ifndef VBX_AUDIO_LOG_H
+#define VBX_AUDIO_LOG_H
+
+// Diagnostic log for the event path. A record is formatted into the
+// calling thread's own ring without taking a lock, so -v no longer makes
+// the reader and playback threads queue on the stdio lock. A background
+// thread drains the rings in time order to stderr or "audio.log.file", and
+// keeps the last "audio.log.history" records for a dump on SIGUSR1, which
+// works in daemon mode where stderr goes to /dev/null.
+
+// Set by log_start() when -v, a log file or a history was asked for
+extern int g_log_enabled;
+
+#define VBX_LOG(...)                                                           \
+  do {                                                                         \
+    if (g_log_enabled)                                                         \
+      log_write(__VA_ARGS__);                                                  \
+  } while (0)
+
+// Start the drain thread if anything is to be logged; -1 if it could not be
+int log_start(void);
+// Write out what is still queued and stop the drain thread
+void log_stop(void);
+// Give the calling thread a ring of its own, shown as `name`. Threads that
+// log without registering get one on their first record.
+void log_register_thread(const char *name);
+// Never blocks: with the thread's ring full the record is counted and lost.
+// No trailing newline.
+void log_write(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+// Have the drain thread write the history to
+// $XDG_RUNTIME_DIR/vbx-log-<uid>.txt; safe in a signal handler
+void log_request_dump(void);
+
+#endif // VBX_AUDIO_LOG_H
@@ -0,0 +1,57 @@
+#ifndef VBX_AUDIO_MIXER_H
+#define VBX_AUDIO_MIXER_H
+
+#include "audio/latency.h"
+#include "audio/types.h"
+
+// Keyboard voices outrank mouse voices when the pool is full
+#define VOICE_PRIORITY_MOUSE 0
+#define VOICE_PRIORITY_KEYBOARD 1
+// Voice not tied to a key, exempt from the retrigger rules
+#define VOICE_NO_GROUP -1
+
+typedef struct {
+  unsigned long voices_started;
+  unsigned long voices_stolen;
+  unsigned long voices_retriggered; // faded out by a later event of their key
+  unsigned long events_dropped;
+  unsigned long peak_voices;
+  unsigned int active_voices; // playing or fading at the last period
+  unsigned long underruns;
+  unsigned int command_high_water; // deepest the voice command queue got
+} MixerStats;
+
+// Open the output backend named in the audio settings. Pull backends then
+// call mixer_render() themselves; push backends are fed by a mixer thread.
+int mixer_init(void);
+void mixer_render(short *out, int frames);
+// Apply the real-time settings to the calling thread, which is about to
+// call mixer_render(). Only for render threads vbx creates: the push thread
+// and the ALSA thread. The Pulse and PipeWire callbacks run on their
+// library's threads, which keep the scheduling the library gives them.
+void mixer_setup_render_thread(void);
+// Queue a voice for `clip`; the render thread starts it at its next period,
+// stealing a playing voice when the polyphony limit is reached. Must always
+// be called from the same thread. With take_ownership the mixer frees the
+// clip once it has finished playing; otherwise the clip must outlive the
+// voice. Returns -1 without taking ownership if the queue is full.
+// Voices of one key share a `group`: a press ends the group's voices still
+// playing, and a release may shorten the press voice, as the retrigger
+// settings say. `times`, if not NULL, is recorded in the latency histograms
+// once the voice's first period is submitted.
+int mixer_play(AudioClip *clip, float gain, int take_ownership, int priority,
+               int group, int is_release, const EventTimes *times);
+// A key release without a sound of its own: fade out the press voices of
+// `group` as a release voice would. Same thread and queue as mixer_play().
+int mixer_release(int group);
+// Free clips the render thread has finished with; called from the
+// mixer_play() thread, which also does so on every call
+void mixer_reclaim(void);
+void mixer_get_stats(MixerStats *out);
+long mixer_output_latency_us(void);
+const char *mixer_backend_name(void);
+void mixer_shutdown(void);
+// Free a clip, or give it back to the sample cache it was lent by
+void free_audio_clip(AudioClip *clip);
+
+#endif // VBX_AUDIO_MIXER_H
@@ -0,0 +1,93 @@
+#ifndef VBX_AUDIO_PACK_H
+#define VBX_AUDIO_PACK_H
+
+#include "audio/soundpack.h"
+#include "audio/types.h"
+#include <stdint.h>
+
+// Pre-decoded sound pack file, used both for the per-user load cache and for
+// distributable .vbxpack bundles. Everything is native-endian and laid out to
+// be used straight from a read-only mmap: a fixed header with the key table,
+// then the clip table, the variation banks, the source list, the banks'
+// clip lists, and 64-byte aligned engine-format PCM that clips index into.
+
+#define PACK_MAGIC "VBXP"
+#define PACK_FORMAT_VERSION 2
+#define PACK_NO_BANK -1
+#define PACK_KEYS 512
+#define PACK_FLAG_MULTI 1u
+// Bundle built by `vbx pack build`, looked for next to config.json
+#define PACK_BUNDLE_NAME "pack.vbxpack"
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t flags;
+  // Hash of the engine format and load options the PCM was produced with
+  uint64_t params;
+  uint32_t num_clips;
+  uint32_t num_sources;
+  uint32_t num_banks;
+  uint32_t num_variants;
+  uint64_t clips_offset;
+  uint64_t banks_offset;
+  uint64_t variants_offset; // int32_t clip indices
+  uint64_t sources_offset;
+  uint64_t pcm_offset;
+  uint64_t pcm_bytes;
+  // Bank indices, or PACK_NO_BANK
+  int32_t generic_press;
+  int32_t release;
+  int32_t key_press[PACK_KEYS];
+  int32_t key_release[PACK_KEYS];
+} PackHeader;
+
+typedef struct {
+  uint64_t offset; // in samples from the start of the PCM block
+  uint32_t frames;
+  uint16_t channels;
+  uint16_t reserved;
+} PackClip;
+
+// Variants first..first+count of the variant list
+typedef struct {
+  uint32_t first;
+  uint32_t count;
+} PackBankEntry;
+
+// A file the pack was built from, relative to the config.json directory
+// unless absolute. A changed mtime or size means the pack is stale.
+typedef struct {
+  int64_t mtime_ns;
+  int64_t size;
+  char path[256];
+} PackSource;
+
+// Parse a pack's config.json into an empty pack without decoding anything
+// (src/audio/config.c)
+int load_sound_config(SoundPack *pack, const char *config_path);
+
+// How this process's packs were loaded
+typedef struct {
+  unsigned int mapped;  // from a bundle or the cache
+  unsigned int decoded; // parsed and decoded from their sound files
+  double load_ms;       // spent in load_sound_pack() altogether
+} PackLoadStats;
+
+// Load a pack for playback: a .vbxpack bundle next to config.json, then the
+// user cache, and finally config.json itself, refreshing the cache. Returns
+// a new pack for sound_pack_free(), or NULL.
+SoundPack *load_sound_pack(const char *config_path);
+void pack_get_load_stats(PackLoadStats *out);
+
+// Write a decoded pack; sources are resolved against config_path's directory
+int write_pack_file(const SoundPack *pack, const char *config_path,
+                    const char *out_path);
+// Map a pack file into `pack`. With `strict` (caches) every source must
+// still exist with the same size and mtime; otherwise (bundles) missing
+// sources are skipped and only a changed size makes the file stale.
+int map_pack_file(SoundPack *pack, const char *path, const char *config_dir,
+                  int strict);
+
+#endif // VBX_AUDIO_PACK_H
@@ -1,9 +1,36 @@
 #ifndef VBX_AUDIO_PLAYBACK_H
 #define VBX_AUDIO_PLAYBACK_H
 
-int init_audio(void);
-int parse_keyboard_event(const char *json_line, int *key_code, int *is_pressed);
-void play_sound_segment(int key_code, int is_pressed);
+#include "audio/latency.h"
+#include "audio/soundpack.h"
+#include "audio/types.h"
+
+// Decode every sound a parsed pack references to engine-format clips
+int decode_sound_pack(SoundPack *pack);
+// Decode a whole file to a freshly allocated engine-format clip
+AudioClip *decode_clip_file(const char *path);
+// Fills the event and sent times vbx-input stamped the line with, or 0
+int parse_keyboard_event(const char *json_line, int *key_code, int *is_pressed,
+                         EventTimes *times);
+void play_sound_segment(int key_code, int is_pressed,
+                        const EventTimes *times);
+
+typedef struct {
+  unsigned int capacity;
+  unsigned int high_water;
+  unsigned long received; // events handed to queue_key_event()
+  unsigned long dropped;
+} EventQueueStats;
+
+// Events from the stdin reader go through a lock-free queue to a playback
+// thread, which looks up or decodes the clip and hands it to the mixer.
+// Mouse buttons play from `mouse`, everything else from `keyboard`; either
+// may be NULL.
+int start_playback_thread(SoundPack *keyboard, SoundPack *mouse);
+// Never blocks; returns -1 and drops the event if the queue is full
+int queue_key_event(int key_code, int is_pressed, const EventTimes *times);
+void stop_playback_thread(void);
+void get_event_queue_stats(EventQueueStats *out);
 
 #endif // VBX_AUDIO_PLAYBACK_H
 
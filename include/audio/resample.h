@@ -0,0 +1,25 @@
+#ifndef VBX_AUDIO_RESAMPLE_H
+#define VBX_AUDIO_RESAMPLE_H
+
+// Load-time conversion of decoded audio to the engine format, so the mixer
+// only ever sees clips at ENGINE_SAMPLE_RATE. Sources with more than two
+// channels are downmixed to stereo; mono stays mono since the mixer upmixes
+// it as it mixes.
+
+typedef struct {
+  unsigned long clips;
+  double milliseconds;
+  long bytes_in;
+  long bytes_out;
+} ResampleStats;
+
+int resample_needed(int channels, int samplerate);
+int resample_channels(int channels);
+// Frames produced from `frames` source frames at `samplerate`
+long resample_frames(long frames, int samplerate);
+// Convert into dst, sized for resample_frames() * resample_channels() samples
+int resample_to_engine(short *dst, const short *src, long frames, int channels,
+                       int samplerate);
+void resample_get_stats(ResampleStats *out);
+
+#endif // VBX_AUDIO_RESAMPLE_H
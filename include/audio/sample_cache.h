@@ -0,0 +1,34 @@
+#ifndef VBX_AUDIO_SAMPLE_CACHE_H
+#define VBX_AUDIO_SAMPLE_CACHE_H
+
+#include "audio/types.h"
+#include <stddef.h>
+
+// Decoded files of lazy multi-mode packs, keyed by path and bounded by the
+// "audio.sample_cache_mb" budget. Least recently used files are evicted
+// first; one that is still playing is freed when its last voice ends. Only
+// used from the playback thread, like mixer_play().
+
+typedef struct {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  double decode_ms; // spent decoding misses and prefetches
+  unsigned int entries;
+  size_t bytes;
+  size_t budget;
+} SampleCacheStats;
+
+// Engine-format clip for `path`, decoding it on a miss, or NULL if the file
+// cannot be decoded. The caller holds a reference until free_audio_clip(),
+// which mixer_play() with take_ownership does once the voice has ended.
+AudioClip *sample_cache_get(const char *path);
+// Decode `path` ahead of use while the cache has room; returns -1 once the
+// budget is full
+int sample_cache_prefetch(const char *path);
+size_t sample_cache_budget(void);
+void sample_cache_get_stats(SampleCacheStats *out);
+// Free every entry; no clip may still be referenced
+void sample_cache_clear(void);
+
+#endif // VBX_AUDIO_SAMPLE_CACHE_H
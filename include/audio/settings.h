@@ -0,0 +1,88 @@
+#ifndef VBX_AUDIO_SETTINGS_H
+#define VBX_AUDIO_SETTINGS_H
+
+typedef enum { STEAL_OLDEST, STEAL_QUIETEST } StealPolicy;
+
+// What a press does to the voices of its key that are still playing
+typedef enum {
+  RETRIGGER_STACK,
+  RETRIGGER_CUT,
+  RETRIGGER_CROSSFADE
+} RetriggerPolicy;
+
+// How a key with several variants picks one
+typedef enum { VARIATION_RANDOM, VARIATION_ROUND_ROBIN } VariationPolicy;
+
+// Buffer attributes requested from PulseAudio ("audio.pulse"). Negative
+// values leave the server default.
+typedef struct {
+  double tlength_ms;
+  double minreq_ms;
+  double prebuf_ms;
+  int adjust_latency;
+  int early_requests;
+} PulseSettings;
+
+// ALSA device and ring geometry ("audio.alsa")
+typedef struct {
+  char device[64];
+  int period_frames;
+  int periods;
+} AlsaSettings;
+
+// Requested graph quantum in frames ("audio.pipewire")
+typedef struct {
+  int quantum;
+} PipewireSettings;
+
+// Opt-in real-time scheduling ("audio.realtime"). vbx-input reads
+// input_cpu through the launcher; vbx-audio --capture-input uses it too.
+typedef struct {
+  int enabled;
+  int priority;    // SCHED_FIFO priority, 1-99
+  int lock_memory; // mlockall() once the packs are loaded
+  int mixer_cpu;   // CPU for a render thread vbx owns; -1 leaves it unpinned
+  int input_cpu;   // CPU for the input dispatch thread
+} RealtimeSettings;
+
+// Silence trimming at load ("audio.trim")
+typedef struct {
+  int enabled;
+  double threshold_db; // dBFS below which a sample counts as silence
+  double fade_ms;      // margin kept around the audible region, faded out
+} TrimSettings;
+
+// Diagnostic log ("audio.log"); see audio/log.h
+typedef struct {
+  int history;    // records kept for a SIGUSR1 dump; 0 keeps none
+  char file[1024]; // written there instead of stderr; empty for stderr
+} LogSettings;
+
+// Engine tuning read from the optional "audio" section of ~/.vbx.json
+typedef struct {
+  int polyphony;
+  StealPolicy steal_policy;
+  RetriggerPolicy retrigger;
+  double retrigger_fade_ms; // fade-out of the replaced voice for crossfade
+  double release_fade_ms;   // release fades the press voice out; 0 never
+  char backend[32];   // output backend name, see find_audio_backend()
+  char wav_path[1024]; // output file of the "wav" backend
+  int cache;           // keep decoded packs under ~/.cache/vbx
+  int sample_cache_mb; // multi packs decoding to more load lazily; 0 never
+  VariationPolicy variation;
+  unsigned int variation_seed; // 0 seeds from the clock
+  PulseSettings pulse;
+  AlsaSettings alsa;
+  PipewireSettings pipewire;
+  RealtimeSettings realtime;
+  TrimSettings trim;
+  LogSettings log;
+} AudioSettings;
+
+extern AudioSettings g_audio_settings;
+
+// Missing file or section keeps the defaults; returns 0 unless the file
+// exists but cannot be parsed
+int load_audio_settings(void);
+
+#endif // VBX_AUDIO_SETTINGS_H
@@ -0,0 +1,103 @@
+#ifndef VBX_AUDIO_SOUNDPACK_H
+#define VBX_AUDIO_SOUNDPACK_H
+
+#include "audio/types.h"
+#include <stddef.h>
+
+// Key codes a pack can define sounds for; 272-274 are the mouse buttons
+#define SOUND_PACK_KEYS 512
+// Most variants one config entry or file pattern can give a key
+#define SOUND_PACK_MAX_VARIANTS 64
+#define NO_SOUND -1
+
+// One distinct sound of a pack, shared by every key that uses it
+typedef struct {
+  int path;        // multi mode: offset of the file path in the string pool
+  int start_ms;    // single mode: range of the pack's sound file
+  int duration_ms;
+  AudioClip clip;  // empty until decoded, and for good in lazy packs
+} PackSound;
+
+// Interchangeable sounds for one key event: variants[first..first+count)
+// are sound indices, one of which is picked on every press. Keys with the
+// same sounds share a bank, so which was picked last is kept per key.
+typedef struct {
+  int first;
+  int count;
+} PackBank;
+
+// Keys that have a sound, kept sorted by code
+typedef struct {
+  unsigned short code;
+  short press; // index into banks, or NO_SOUND
+  short release;
+} PackKey;
+
+// A loaded sound pack. Each device has its own, created by load_sound_pack()
+// and passed around by pointer; clips point into the pack's sample arena,
+// the shared interned clips, or the pack file it was mapped from.
+typedef struct {
+  int is_multi;
+  // Multi pack bigger than the sample cache budget: clips stay empty and
+  // files are decoded through the cache on first use instead
+  int lazy;
+  PackKey *keys;
+  int num_keys;
+  int keys_capacity;
+  PackSound *sounds;
+  int num_sounds;
+  int sounds_capacity;
+  PackBank *banks;
+  int num_banks;
+  int banks_capacity;
+  int *variants;
+  int num_variants;
+  int variants_capacity;
+  // Multi mode: banks of keys without a press or release bank of their own
+  int generic_press;
+  int release;
+  // Variant each key's press [0] and release [1] played last, or -1; only
+  // the playback thread
+  short last_variant[SOUND_PACK_KEYS][2];
+  // Pre-render pitch-shifted copies of every sound as extra variants
+  int random_pitch;
+  int sound_file; // single mode: string pool offset, or -1
+  // Every path once, NUL-separated
+  char *strings;
+  size_t strings_used;
+  size_t strings_capacity;
+  // Single mode: every decoded range, contiguous
+  short *samples;
+  long sample_frames;
+  // Pitch variants, contiguous
+  short *variant_samples;
+  // Pack file or cache the clips point into, when loaded from one
+  void *mapping;
+  size_t mapping_size;
+} SoundPack;
+
+SoundPack *sound_pack_new(void);
+// Free everything the pack owns, leaving it empty for reuse
+void sound_pack_clear(SoundPack *pack);
+void sound_pack_free(SoundPack *pack);
+
+// Offset of `s` in the string pool, adding it if it is new; -1 on failure
+int sound_pack_intern(SoundPack *pack, const char *s);
+// NULL for -1
+const char *sound_pack_string(const SoundPack *pack, int offset);
+// Index of the sound for a file or a range of the single-mode file, adding
+// it if it is new; NO_SOUND on failure
+int sound_pack_add_file(SoundPack *pack, const char *path);
+int sound_pack_add_range(SoundPack *pack, int start_ms, int duration_ms);
+// Append a sound that is already decoded, such as one mapped from a file
+int sound_pack_add_clip(SoundPack *pack, const AudioClip *clip);
+// Index of the bank of `count` sounds, adding it if no bank has the same
+// ones; NO_SOUND on failure
+int sound_pack_add_bank(SoundPack *pack, const int *sounds, int count);
+// Give `code` a press or release bank; returns -1 on failure
+int sound_pack_set_key(SoundPack *pack, int code, int is_release, int bank);
+const PackKey *sound_pack_find_key(const SoundPack *pack, int code);
+// File of a multi-mode sound
+const char *sound_pack_path(const SoundPack *pack, int sound);
+
+#endif // VBX_AUDIO_SOUNDPACK_H
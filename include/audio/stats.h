@@ -0,0 +1,17 @@
+#ifndef VBX_AUDIO_STATS_H
+#define VBX_AUDIO_STATS_H
+
+// Live engine counters for `vbx --stats`. vbx-audio rewrites them once a
+// second as JSON into $XDG_RUNTIME_DIR/vbx-stats-<uid>.json, next to the
+// mute and enable files the launcher already shares with it, so reading
+// them needs no connection to the engine and works in daemon mode.
+
+#include <time.h>
+
+// Write the current counters of an engine that started at `started`;
+// returns -1 if the file could not be written
+int write_engine_stats(time_t started);
+// Remove the file on exit, so a stale one never looks like a live engine
+void remove_engine_stats(void);
+
+#endif // VBX_AUDIO_STATS_H
@@ -0,0 +1,24 @@
+#ifndef VBX_AUDIO_TRIM_H
+#define VBX_AUDIO_TRIM_H
+
+#include "audio/types.h"
+
+// Load-time trimming of silent lead-ins and tails ("audio.trim"). A lead-in
+// delays the click by its length and a tail keeps a voice busy after the
+// sound has died away, so both are cut down to a short margin around the
+// audible region, faded so the new edges do not click.
+
+typedef struct {
+  unsigned long clips;   // clips analysed
+  unsigned long trimmed; // clips that were shortened
+  double lead_ms;        // silence removed before the sound starts
+  double tail_ms;        // silence removed after it ends
+  double total_ms;       // length of the clips before trimming
+} TrimStats;
+
+// Trim `clip` in place: the audible region moves to the start of its
+// buffer and frames shrinks. Clips that are silent throughout are kept.
+void trim_clip(AudioClip *clip);
+void trim_get_stats(TrimStats *out);
+
+#endif // VBX_AUDIO_TRIM_H
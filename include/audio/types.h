@@ -1,38 +1,26 @@
 #ifndef VBX_AUDIO_TYPES_H
 #define VBX_AUDIO_TYPES_H
 
-#include <sndfile.h>
+// Hard ceiling for the configurable polyphony limit ("audio.polyphony")
+#define MAX_POLYPHONY 32
+#define DEFAULT_POLYPHONY 16
 
-#define MAX_CONCURRENT_SOUNDS 10
+// Format of the single long-lived output stream every voice is mixed into
+#define ENGINE_SAMPLE_RATE 48000
+#define ENGINE_CHANNELS 2
+#define MIXER_PERIOD_FRAMES 256
 
-typedef struct {
-  int start_ms;
-  int duration_ms;
-} SoundMapping;
+// Decoded interleaved S16 audio, in the format of its source file
+typedef struct AudioClip {
+  short *pcm;
+  long frames;
+  int channels;
+  int samplerate;
+  // Set on clips lent out by the sample cache; free_audio_clip() hands the
+  // reference back through it instead of freeing
+  void (*release)(struct AudioClip *clip);
+} AudioClip;
 
-typedef struct {
-  char press_file[256];
-  char release_file[256];
-  char generic_press_files[5][256];
-  int num_generic_press_files;
-  char sound_file[256];
-  SoundMapping key_mappings[512];
-  struct {
-    char *press;
-    char *release;
-  } multi_key_mappings[512];
-  int is_multi;
-  SF_INFO sf_info;
-} SoundPack;
-
-typedef struct {
-  int key_code;
-  int thread_id;
-  int is_pressed;
-} PlaybackData;
-
-extern SoundPack g_sound_pack;
-extern SoundPack g_mouse_sound_pack;
 extern float g_volume;
 extern float g_mouse_volume;
 extern int g_verbose;
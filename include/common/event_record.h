@@ -0,0 +1,31 @@
+#ifndef VBX_EVENT_RECORD_H
+#define VBX_EVENT_RECORD_H
+
+#include <stdint.h>
+
+// What vbx-input writes down the pipe to vbx-audio for each key or button:
+// a fixed-size record in host byte order, both ends being built together
+// and running on the same machine. vbx-input writes all the records of one
+// libinput_dispatch() in a single write(). `vbx-input --json` writes the
+// older JSON lines instead, for reading by eye; vbx-audio accepts either,
+// telling them apart by the first byte.
+
+#define EVENT_RECORD_MAGIC 0xB5 // never the start of a JSON line
+#define EVENT_RECORD_VERSION 1
+
+typedef enum { EVENT_DEVICE_KEYBOARD = 0, EVENT_DEVICE_POINTER = 1 } EventDevice;
+
+typedef struct {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t device; // EventDevice
+  uint8_t pressed;
+  uint32_t code;    // evdev key or button code
+  uint64_t time_us; // libinput's CLOCK_MONOTONIC event time
+  uint64_t sent_us; // when vbx-input wrote the batch, same clock
+} EventRecord;
+
+// A record must not grow or gain padding without a new version
+typedef char event_record_size_check[sizeof(EventRecord) == 24 ? 1 : -1];
+
+#endif // VBX_EVENT_RECORD_H
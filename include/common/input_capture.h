@@ -0,0 +1,30 @@
+#ifndef VBX_INPUT_CAPTURE_H
+#define VBX_INPUT_CAPTURE_H
+
+#include "common/event_record.h"
+
+// Key and button capture through libinput on seat0, shared by vbx-input,
+// which writes the events down the pipe, and the single-process mode of
+// vbx-audio, which queues them for playback directly.
+
+typedef struct InputCapture InputCapture;
+
+// Handed the events of one libinput_dispatch(), up to
+// INPUT_CAPTURE_BATCH at a time; sent_us is left 0 for the sink to stamp
+typedef void (*InputSink)(EventRecord *records, int count, void *user);
+
+// 1.5 KiB of records, under PIPE_BUF, so a batch is one atomic pipe write
+#define INPUT_CAPTURE_BATCH 64
+
+// Open seat0 and take the initial device events. Returns NULL, having
+// said why on stderr, if that fails or no device can be read.
+InputCapture *input_capture_open(void);
+// Wait for and dispatch events until input_capture_stop(); returns -1 if
+// polling fails
+int input_capture_run(InputCapture *capture, InputSink sink, void *user);
+// Make input_capture_run() return 0, from any thread. The sink is not
+// called again once it has returned.
+void input_capture_stop(InputCapture *capture);
+void input_capture_close(InputCapture *capture);
+
+#endif // VBX_INPUT_CAPTURE_H
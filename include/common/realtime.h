@@ -0,0 +1,25 @@
+#ifndef VBX_REALTIME_H
+#define VBX_REALTIME_H
+
+// Real-time scheduling for the threads on the click path, shared by
+// vbx-audio and vbx-input
+
+// rtkit's default ceiling; higher priorities are only granted directly
+#define REALTIME_DEFAULT_PRIORITY 20
+// Ranges "audio.realtime" is clamped to, by vbx-audio and by the launcher
+// for vbx-input alike
+#define REALTIME_MIN_PRIORITY 1
+#define REALTIME_MAX_PRIORITY 99
+#define REALTIME_MAX_CPU 1023
+
+// Make the calling thread SCHED_FIFO at `priority`: directly when the
+// process may (CAP_SYS_NICE or RLIMIT_RTPRIO), otherwise through rtkit when
+// built with it. Returns -1 if neither allowed it.
+int realtime_promote_thread(int priority);
+// Pin the calling thread to `cpu`; a negative cpu leaves it alone
+int realtime_pin_thread(int cpu);
+// Both of the above for the thread called `name`, warning on stderr about
+// whatever could not be done. Returns 0 only if everything was applied.
+int realtime_setup_thread(const char *name, int priority, int cpu);
+
+#endif // VBX_REALTIME_H
@@ -0,0 +1,31 @@
+#ifndef VBX_SPSC_H
+#define VBX_SPSC_H
+
+#include <stddef.h>
+
+// Wait-free single-producer/single-consumer ring of fixed-size records. One
+// thread may push and one other thread may pop concurrently; neither side
+// ever blocks or takes a lock.
+typedef struct {
+  unsigned char *records;
+  size_t record_size;
+  unsigned int mask;
+  // Free-running counters; head is written by the consumer, tail by the
+  // producer. Kept on separate cache lines to avoid false sharing.
+  unsigned int head __attribute__((aligned(64)));
+  unsigned int tail __attribute__((aligned(64)));
+  unsigned int high_water;
+} SpscRing;
+
+// capacity is rounded up to a power of two
+int spsc_init(SpscRing *ring, size_t record_size, unsigned int capacity);
+void spsc_free(SpscRing *ring);
+// Returns 0 when the ring is full
+int spsc_push(SpscRing *ring, const void *record);
+// Returns 0 when the ring is empty
+int spsc_pop(SpscRing *ring, void *record);
+unsigned int spsc_capacity(const SpscRing *ring);
+// Deepest the ring has been since spsc_init
+unsigned int spsc_high_water(const SpscRing *ring);
+
+#endif // VBX_SPSC_H
@@ -0,0 +1,35 @@
+#ifndef VBX_TRACE_H
+#define VBX_TRACE_H
+
+// USDT probes on the event and playback path, for bpftrace or perf to
+// attach to a running vbx-input or vbx-audio:
+//
+//   bpftrace -e 'usdt:/usr/bin/vbx-audio:vbx:voice_start { ... }'
+//
+// A probe is a single nop until a tracer attaches, but its arguments are
+// still computed, so they are kept to values the code has at hand anyway,
+// plus the clock on probes that are rare and mark a moment. Built in whenever <sys/sdt.h>
+// (systemtap-sdt-dev) is installed; define VBX_NO_USDT to leave them out.
+// Probe arguments are integers or pointers, as sdt.h requires.
+
+#if !defined(VBX_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define VBX_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef VBX_HAVE_USDT
+#define VBX_PROBE1(name, a) DTRACE_PROBE1(vbx, name, a)
+#define VBX_PROBE2(name, a, b) DTRACE_PROBE2(vbx, name, a, b)
+#define VBX_PROBE3(name, a, b, c) DTRACE_PROBE3(vbx, name, a, b, c)
+#define VBX_PROBE4(name, a, b, c, d) DTRACE_PROBE4(vbx, name, a, b, c, d)
+#else
+#define VBX_PROBE1(name, a) ((void)(a))
+#define VBX_PROBE2(name, a, b) ((void)(a), (void)(b))
+#define VBX_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+#define VBX_PROBE4(name, a, b, c, d)                                           \
+  ((void)(a), (void)(b), (void)(c), (void)(d))
+#endif
+
+#endif // VBX_TRACE_H
@@ -2,6 +2,7 @@
 #define VBX_UTILS_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
 
@@ -15,6 +16,8 @@ int errorf(const char *fmt, ...);
 // Common runtime helpers
 const char *get_runtime_dir(void);
 void build_pidfile_path(char *buffer, size_t buflen);
+// Counters vbx-audio publishes for `vbx --stats`
+void build_stats_path(char *buffer, size_t buflen);
 int read_pidfile(const char *path, pid_t *out_pid);
 int write_pidfile(const char *path, pid_t pid);
 int process_is_running(pid_t pid);
@@ -32,6 +35,9 @@ int write_runtime_mouse_enabled_file(int enabled);
 // Helper functions
 void int_to_str(char *buffer, size_t size, int value);
 char *xstrdup(const char *s);
+// 64-bit FNV-1a; start from FNV1A_OFFSET and chain calls to hash in pieces
+#define FNV1A_OFFSET 14695981039346656037ULL
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len);
 int validate_volume(int volume);
 const char *get_home_dir(void);
 void safe_strncpy(char *dest, const char *src, size_t dest_size);
@@ -15,4 +15,13 @@ int read_user_config(const char *path, char **out_keyboard_sound,
                      char **out_mouse_sound, int *out_keyboard_volume,
                      int *out_mouse_volume, int *out_keyboard_enabled, int *out_mouse_enabled);
 
+// Read the "audio.realtime" section for vbx-input; returns 1 if real-time
+// mode is enabled, leaving the outputs untouched for missing keys. Values
+// are clamped to the ranges vbx-audio uses.
+int read_realtime_config(const char *path, int *out_priority, int *out_cpu);
+
+// Read "audio.single_process": 1 if vbx-audio should capture input itself
+// instead of running vbx-input beside it
+int read_single_process_config(const char *path);
+
 #endif // VBX_CONFIG_IO_H
@@ -0,0 +1,92 @@
+#define _POSIX_C_SOURCE 200809L
+#include "app/pack_build.h"
+#include "audio/pack.h"
+#include "common/utils.h"
+#include "config.h"
+#include "soundpacks.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_PATH_LENGTH 1024
+
+static void print_pack_usage(void) {
+  printf("Usage: vbx pack build PACK [-o FILE] [-v]\n\n");
+  printf("Compile a sound pack into a single pre-decoded %s file, which\n",
+         PACK_BUNDLE_NAME);
+  printf("is loaded instead of the pack's sound files when present.\n\n");
+  printf("  PACK       Pack directory, or the name of an installed pack\n");
+  printf("  -o FILE    Output file (default: PACK/%s)\n", PACK_BUNDLE_NAME);
+  printf("  -v         Show detailed output\n");
+}
+
+// A directory holding config.json, else a keyboard or mouse pack name
+static int resolve_pack_dir(const char *pack, char *out, size_t size) {
+  char config_path[MAX_PATH_LENGTH];
+  char base[MAX_PATH_LENGTH];
+  struct stat st;
+  if (stat(pack, &st) == 0 && S_ISDIR(st.st_mode)) {
+    if (!safe_snprintf(config_path, sizeof(config_path), "%s/config.json",
+                       pack) ||
+        access(config_path, R_OK) != 0) {
+      fprintf(stderr, "Error: No config.json in %s\n", pack);
+      return 0;
+    }
+    safe_strncpy(out, pack, size);
+    return 1;
+  }
+  if (resolve_keyboard_sound_base_dir(pack, base, sizeof(base)) ||
+      resolve_mouse_sound_base_dir(pack, base, sizeof(base)))
+    return safe_snprintf(out, size, "%s/%s", base, pack);
+  fprintf(stderr, "Error: Sound pack '%s' not found.\n", pack);
+  fprintf(stderr, "Use --list to see available sound packs.\n");
+  return 0;
+}
+
+int run_pack_command(int argc, char **argv) {
+  if (argc < 2 || strcmp(argv[1], "build") != 0) {
+    print_pack_usage();
+    return argc < 2 ? 0 : 1;
+  }
+  const char *pack = NULL;
+  const char *out = NULL;
+  const char *verbose = "0";
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      out = argv[++i];
+    } else if (strcmp(argv[i], "-v") == 0) {
+      verbose = "1";
+    } else if (argv[i][0] != '-' && !pack) {
+      pack = argv[i];
+    } else {
+      print_pack_usage();
+      return 1;
+    }
+  }
+  if (!pack) {
+    print_pack_usage();
+    return 1;
+  }
+  char pack_dir[MAX_PATH_LENGTH];
+  char config_path[MAX_PATH_LENGTH];
+  char out_path[MAX_PATH_LENGTH];
+  char audio_path[MAX_PATH_LENGTH];
+  if (!resolve_pack_dir(pack, pack_dir, sizeof(pack_dir)) ||
+      !safe_snprintf(config_path, sizeof(config_path), "%s/config.json",
+                     pack_dir))
+    return 1;
+  if (!out) {
+    if (!safe_snprintf(out_path, sizeof(out_path), "%s/%s", pack_dir,
+                       PACK_BUNDLE_NAME))
+      return 1;
+    out = out_path;
+  }
+  // Decoding needs the audio engine, so vbx-audio does the actual work
+  safe_snprintf_wrapper(audio_path, sizeof(audio_path), "%s/vbx-audio",
+                        VBX_BIN_DIR);
+  execl(audio_path, "vbx-audio", "--build-pack", config_path, out, verbose,
+        (char *)NULL);
+  perror("execl vbx-audio");
+  return 1;
+}
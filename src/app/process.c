@@ -1,7 +1,9 @@
 #define _POSIX_C_SOURCE 200809L
 #include "app/process.h"
 #include "common/utils.h"
+#include "common/realtime.h"
 #include "config.h"
+#include "user_config.h"
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
@@ -95,6 +97,11 @@ int start_children(const char *sound_dir, const char *config_path, int volume,
                    int mouse_enabled) {
   (void)config_path;
   (void)mouse_sound_dir;
+  // Re-read on every start so a reload picks up changes
+  char user_cfg_path[MAX_PATH_LENGTH];
+  int single_process =
+      get_user_config_path(user_cfg_path, sizeof(user_cfg_path)) &&
+      read_single_process_config(user_cfg_path);
   int pipefd[2];
   if (pipe(pipefd) == -1) {
     perror("pipe");
@@ -131,13 +138,25 @@ int start_children(const char *sound_dir, const char *config_path, int volume,
     int_to_str(keyboard_enabled_str, sizeof(keyboard_enabled_str), keyboard_enabled);
     int_to_str(mouse_enabled_str, sizeof(mouse_enabled_str), mouse_enabled);
     
-    execl(sound_player_path, "vbx-audio", "config.json", volume_str,
-          verbose_str, mute_str, mouse_config_path, mouse_volume_str,
-          keyboard_mute_str, mouse_mute_str, keyboard_enabled_str,
-          mouse_enabled_str, (char *)NULL);
+    if (single_process)
+      execl(sound_player_path, "vbx-audio", "--capture-input", "config.json",
+            volume_str, verbose_str, mute_str, mouse_config_path,
+            mouse_volume_str, keyboard_mute_str, mouse_mute_str,
+            keyboard_enabled_str, mouse_enabled_str, (char *)NULL);
+    else
+      execl(sound_player_path, "vbx-audio", "config.json", volume_str,
+            verbose_str, mute_str, mouse_config_path, mouse_volume_str,
+            keyboard_mute_str, mouse_mute_str, keyboard_enabled_str,
+            mouse_enabled_str, (char *)NULL);
     perror("execl vbx-audio");
     exit(1);
   }
+  // vbx-audio reads the devices itself and never looks at the pipe
+  if (single_process) {
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return 1;
+  }
   keyboard_pid = fork();
   if (keyboard_pid == -1) {
     perror("fork");
@@ -153,7 +172,17 @@ int start_children(const char *sound_dir, const char *config_path, int volume,
     close(pipefd[0]);
     dup2(pipefd[1], STDOUT_FILENO);
     close(pipefd[1]);
-    execl(get_key_presses_path, "vbx-input", (char *)NULL);
+    char priority_arg[32], cpu_arg[32];
+    int priority = REALTIME_DEFAULT_PRIORITY, cpu = -1;
+    if (get_user_config_path(user_cfg_path, sizeof(user_cfg_path)) &&
+        read_realtime_config(user_cfg_path, &priority, &cpu)) {
+      snprintf(priority_arg, sizeof(priority_arg), "--realtime=%d", priority);
+      snprintf(cpu_arg, sizeof(cpu_arg), "--cpu=%d", cpu);
+      execl(get_key_presses_path, "vbx-input", priority_arg, cpu_arg,
+            (char *)NULL);
+    } else {
+      execl(get_key_presses_path, "vbx-input", (char *)NULL);
+    }
     perror("execl vbx-input");
     exit(1);
   }
@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+#include "app/stats.h"
+#include "common/utils.h"
+#include <json-c/json.h>
+#include <stdio.h>
+#include <time.h>
+
+#define MAX_PATH_LENGTH 1024
+// The engine rewrites the file every second, unless its main loop is stuck
+#define STALE_SECONDS 5
+
+static json_object *field(json_object *obj, const char *key) {
+  json_object *value = NULL;
+  if (obj)
+    json_object_object_get_ex(obj, key, &value);
+  return value;
+}
+
+static int64_t get_int(json_object *obj, const char *key) {
+  return json_object_get_int64(field(obj, key));
+}
+
+static double get_double(json_object *obj, const char *key) {
+  return json_object_get_double(field(obj, key));
+}
+
+static void print_table(json_object *root) {
+  json_object *events = field(root, "events");
+  json_object *voices = field(root, "voices");
+  json_object *cache = field(root, "sample_cache");
+  json_object *packs = field(root, "packs");
+  json_object *latency = field(root, "latency_us");
+
+  printf("VBX audio engine (pid %lld, up %llds)\n",
+         (long long)get_int(root, "pid"), (long long)get_int(root, "uptime"));
+  printf("  Backend:          %s, %lld us output latency\n",
+         json_object_get_string(field(root, "backend")),
+         (long long)get_int(root, "output_latency_us"));
+  printf("  Events received:  %lld\n", (long long)get_int(events, "received"));
+  printf("  Events dropped:   %lld (queue high-water %lld/%lld)\n",
+         (long long)get_int(events, "dropped"),
+         (long long)get_int(events, "queue_high_water"),
+         (long long)get_int(events, "queue_capacity"));
+  printf("  Voices active:    %lld (peak %lld/%lld)\n",
+         (long long)get_int(voices, "active"),
+         (long long)get_int(voices, "peak"),
+         (long long)get_int(voices, "polyphony"));
+  printf("  Voices started:   %lld\n", (long long)get_int(voices, "started"));
+  printf("  Voices stolen:    %lld (%lld retriggered)\n",
+         (long long)get_int(voices, "stolen"),
+         (long long)get_int(voices, "retriggered"));
+  printf("  Sample cache:     %.1f/%.0f MiB in %lld files, %lld hits, "
+         "%lld misses, %lld evictions\n",
+         get_int(cache, "bytes") / 1048576.0,
+         get_int(cache, "budget") / 1048576.0,
+         (long long)get_int(cache, "entries"),
+         (long long)get_int(cache, "hits"),
+         (long long)get_int(cache, "misses"),
+         (long long)get_int(cache, "evictions"));
+  printf("  Decode time:      %.1f ms (packs: %lld mapped, %lld decoded, "
+         "%.1f ms loading)\n",
+         get_double(cache, "decode_ms"), (long long)get_int(packs, "mapped"),
+         (long long)get_int(packs, "decoded"), get_double(packs, "load_ms"));
+  printf("  Underruns:        %lld\n", (long long)get_int(root, "underruns"));
+  if (!json_object_is_type(latency, json_type_object))
+    return;
+  printf("\n  %-8s %8s %9s %9s %9s %9s %9s\n", "latency", "count", "mean",
+         "p50", "p90", "p99", "max");
+  // In the engine's stage order, which json-c keeps
+  json_object_object_foreach(latency, name, s) {
+    printf("  %-8s %8lld %9.0f %9lld %9lld %9lld %9lld\n", name,
+           (long long)get_int(s, "count"), get_double(s, "mean"),
+           (long long)get_int(s, "p50"), (long long)get_int(s, "p90"),
+           (long long)get_int(s, "p99"), (long long)get_int(s, "max"));
+  }
+}
+
+int print_engine_stats(int json) {
+  char path[MAX_PATH_LENGTH];
+  build_stats_path(path, sizeof(path));
+  json_object *root = json_object_from_file(path);
+  // A file left by an engine that crashed is not a running engine
+  if (!root || !process_is_running((pid_t)get_int(root, "pid"))) {
+    fprintf(stderr, "VBX audio engine is not running.\n");
+    if (root)
+      json_object_put(root);
+    return 1;
+  }
+  long long age = (long long)(time(NULL) - get_int(root, "updated"));
+  if (age > STALE_SECONDS)
+    fprintf(stderr, "Warning: Stats are %llds old; the engine may be stuck\n",
+            age);
+  if (json)
+    printf("%s\n", json_object_to_json_string_ext(root, JSON_C_TO_STRING_PLAIN));
+  else
+    print_table(root);
+  json_object_put(root);
+  return 0;
+}
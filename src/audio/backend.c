@@ -0,0 +1,55 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/backend.h"
+#include "audio/types.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define LATE_RESET_NS 50000000L
+
+static const AudioBackend *const backends[] = {
+    &pulse_backend,
+#ifdef VBX_WITH_PIPEWIRE
+    &pipewire_backend,
+#endif
+#ifdef VBX_WITH_ALSA
+    &alsa_backend,
+#endif
+    &null_backend,  &wav_backend};
+
+const AudioBackend *find_audio_backend(const char *name) {
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    if (strcmp(backends[i]->name, name) == 0)
+      return backends[i];
+  }
+  return NULL;
+}
+
+void print_audio_backends(void) {
+  fprintf(stderr, "Available audio backends:");
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    fprintf(stderr, " %s", backends[i]->name);
+  fprintf(stderr, "\n");
+}
+
+void backend_clock_wait(BackendClock *clock, int frames) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long now_ns = (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+  if (!clock->started) {
+    clock->next_ns = now_ns;
+    clock->started = 1;
+  }
+  clock->next_ns += (long long)frames * 1000000000LL / ENGINE_SAMPLE_RATE;
+  if (now_ns - clock->next_ns > LATE_RESET_NS) {
+    clock->late++;
+    clock->next_ns = now_ns;
+    return;
+  }
+  struct timespec deadline = {.tv_sec = (time_t)(clock->next_ns / 1000000000LL),
+                              .tv_nsec = (long)(clock->next_ns % 1000000000LL)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) ==
+         EINTR)
+    ;
+}
@@ -0,0 +1,198 @@
+#include "audio/backend.h"
+#include "audio/mixer.h"
+#include "audio/types.h"
+#include <alsa/asoundlib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Direct ALSA output. The mixer renders straight into the device's mmap ring
+// from a dedicated thread; devices without mmap support fall back to
+// snd_pcm_writei from a period buffer.
+
+#define FRAME_BYTES (ENGINE_CHANNELS * sizeof(short))
+
+static snd_pcm_t *pcm = NULL;
+static RenderFn render_fn = NULL;
+static pthread_t alsa_thread;
+static volatile int alsa_running = 0;
+static int use_mmap = 1;
+static snd_pcm_uframes_t period_size = 0;
+static snd_pcm_uframes_t buffer_size = 0;
+static short *period_buffer = NULL;
+static volatile unsigned long underruns = 0;
+
+// Recover from an xrun or suspend; the ring restarts once it is refilled
+static int recover(int err) {
+  if (err == -EPIPE || err == -ESTRPIPE)
+    underruns++;
+  err = snd_pcm_recover(pcm, err, 1);
+  if (err < 0)
+    fprintf(stderr, "ALSA recovery failed: %s\n", snd_strerror(err));
+  return err;
+}
+
+static int fill_mmap(snd_pcm_uframes_t frames) {
+  while (frames > 0) {
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset, n = frames;
+    int err = snd_pcm_mmap_begin(pcm, &areas, &offset, &n);
+    if (err < 0)
+      return err;
+    // Interleaved S16: channel 0's area addresses the whole frame
+    short *dst = (short *)((char *)areas[0].addr + areas[0].first / 8 +
+                           offset * areas[0].step / 8);
+    render_fn(dst, (int)n);
+    snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, n);
+    if (committed < 0)
+      return (int)committed;
+    if ((snd_pcm_uframes_t)committed != n)
+      return -EPIPE;
+    frames -= n;
+  }
+  return 0;
+}
+
+static int fill_writei(snd_pcm_uframes_t frames) {
+  while (frames > 0) {
+    snd_pcm_uframes_t n = frames < period_size ? frames : period_size;
+    render_fn(period_buffer, (int)n);
+    snd_pcm_sframes_t written = snd_pcm_writei(pcm, period_buffer, n);
+    if (written < 0)
+      return (int)written;
+    frames -= (snd_pcm_uframes_t)written;
+  }
+  return 0;
+}
+
+static void *alsa_thread_main(void *arg) {
+  (void)arg;
+  mixer_setup_render_thread();
+  while (alsa_running) {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+    if (avail < 0) {
+      if (recover((int)avail) < 0)
+        break;
+      continue;
+    }
+    if ((snd_pcm_uframes_t)avail < period_size) {
+      int err = snd_pcm_wait(pcm, 100);
+      if (err < 0 && recover(err) < 0)
+        break;
+      continue;
+    }
+    // Only whole periods, so every wakeup renders the same amount
+    snd_pcm_uframes_t frames = avail - avail % period_size;
+    int err = use_mmap ? fill_mmap(frames) : fill_writei(frames);
+    if (err < 0 && recover(err) < 0)
+      break;
+  }
+  return NULL;
+}
+
+static int set_params(const AlsaSettings *settings) {
+  snd_pcm_hw_params_t *hw;
+  snd_pcm_sw_params_t *sw;
+  snd_pcm_hw_params_alloca(&hw);
+  snd_pcm_sw_params_alloca(&sw);
+  int err = snd_pcm_hw_params_any(pcm, hw);
+  if (err < 0)
+    return err;
+  if (snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED) <
+      0) {
+    use_mmap = 0;
+    err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_RW_INTERLEAVED);
+    if (err < 0)
+      return err;
+  }
+  unsigned int rate = ENGINE_SAMPLE_RATE;
+  if ((err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16)) < 0 ||
+      (err = snd_pcm_hw_params_set_channels(pcm, hw, ENGINE_CHANNELS)) < 0 ||
+      (err = snd_pcm_hw_params_set_rate(pcm, hw, rate, 0)) < 0)
+    return err;
+  period_size = (snd_pcm_uframes_t)settings->period_frames;
+  buffer_size = period_size * (snd_pcm_uframes_t)settings->periods;
+  if ((err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &period_size,
+                                                    NULL)) < 0 ||
+      (err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer_size)) <
+          0 ||
+      (err = snd_pcm_hw_params(pcm, hw)) < 0)
+    return err;
+  // Start once every whole period of the ring has been filled
+  if ((err = snd_pcm_sw_params_current(pcm, sw)) < 0 ||
+      (err = snd_pcm_sw_params_set_avail_min(pcm, sw, period_size)) < 0 ||
+      (err = snd_pcm_sw_params_set_start_threshold(
+           pcm, sw, buffer_size - buffer_size % period_size)) < 0 ||
+      (err = snd_pcm_sw_params(pcm, sw)) < 0)
+    return err;
+  return 0;
+}
+
+static void alsa_close(void);
+
+static int alsa_open(const AudioSettings *audio, RenderFn render) {
+  const AlsaSettings *settings = &audio->alsa;
+  render_fn = render;
+  use_mmap = 1;
+  underruns = 0;
+  int err = snd_pcm_open(&pcm, settings->device, SND_PCM_STREAM_PLAYBACK, 0);
+  if (err < 0) {
+    fprintf(stderr, "Could not open ALSA device %s: %s\n", settings->device,
+            snd_strerror(err));
+    pcm = NULL;
+    return -1;
+  }
+  if ((err = set_params(settings)) < 0) {
+    fprintf(stderr, "Could not configure ALSA device %s: %s\n",
+            settings->device, snd_strerror(err));
+    alsa_close();
+    return -1;
+  }
+  if (!use_mmap) {
+    period_buffer = malloc(period_size * FRAME_BYTES);
+    if (!period_buffer) {
+      alsa_close();
+      return -1;
+    }
+  }
+  if (g_verbose) {
+    printf("ALSA %s: %s access, period %lu frames, buffer %lu frames\n",
+           settings->device, use_mmap ? "mmap" : "read/write",
+           (unsigned long)period_size, (unsigned long)buffer_size);
+  }
+  alsa_running = 1;
+  if (pthread_create(&alsa_thread, NULL, alsa_thread_main, NULL) != 0) {
+    fprintf(stderr, "Could not start ALSA thread\n");
+    alsa_running = 0;
+    alsa_close();
+    return -1;
+  }
+  return 0;
+}
+
+static long alsa_latency_us(void) {
+  snd_pcm_sframes_t delay = 0;
+  if (!pcm || snd_pcm_delay(pcm, &delay) < 0)
+    return -1;
+  return delay < 0 ? 0 : (long)(delay * 1000000L / ENGINE_SAMPLE_RATE);
+}
+
+static unsigned long alsa_underruns(void) { return underruns; }
+
+static void alsa_close(void) {
+  if (alsa_running) {
+    alsa_running = 0;
+    pthread_join(alsa_thread, NULL);
+  }
+  if (pcm) {
+    snd_pcm_drop(pcm);
+    snd_pcm_close(pcm);
+    pcm = NULL;
+  }
+  free(period_buffer);
+  period_buffer = NULL;
+}
+
+const AudioBackend alsa_backend = {"alsa",         alsa_open,
+                                   NULL,           alsa_latency_us,
+                                   alsa_underruns, alsa_close};
@@ -0,0 +1,32 @@
+#include "audio/backend.h"
+#include "audio/types.h"
+
+// Discards everything but keeps real-time pacing, so the engine can be
+// load-tested and profiled without a sound server
+
+static BackendClock null_clock;
+
+static int null_open(const AudioSettings *settings, RenderFn render) {
+  (void)settings;
+  (void)render;
+  null_clock = (BackendClock){0};
+  return 0;
+}
+
+static int null_write(const short *frames, int count) {
+  (void)frames;
+  backend_clock_wait(&null_clock, count);
+  return 0;
+}
+
+static long null_latency_us(void) {
+  return MIXER_PERIOD_FRAMES * 1000000L / ENGINE_SAMPLE_RATE;
+}
+
+static unsigned long null_underruns(void) { return null_clock.late; }
+
+static void null_close(void) {}
+
+const AudioBackend null_backend = {"null",         null_open,
+                                   null_write,     null_latency_us,
+                                   null_underruns, null_close};
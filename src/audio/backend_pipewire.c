@@ -0,0 +1,203 @@
+#include "audio/backend.h"
+#include "audio/types.h"
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+#include <stdio.h>
+
+// Native PipeWire stream. The mix is rendered in the stream's process
+// callback on the PipeWire data thread, with a node latency hint asking the
+// graph for a small quantum.
+
+#define FRAME_BYTES (ENGINE_CHANNELS * sizeof(short))
+#define CONNECT_TIMEOUT_S 2
+
+static struct pw_thread_loop *loop = NULL;
+static struct pw_stream *stream = NULL;
+static RenderFn render_fn = NULL;
+static enum pw_stream_state stream_state = PW_STREAM_STATE_UNCONNECTED;
+static volatile unsigned int last_quantum = 0;
+static volatile unsigned long underruns = 0;
+
+static void on_state_changed(void *userdata, enum pw_stream_state old,
+                             enum pw_stream_state state, const char *error) {
+  (void)userdata;
+  (void)old;
+  stream_state = state;
+  if (state == PW_STREAM_STATE_ERROR)
+    fprintf(stderr, "PipeWire stream error: %s\n", error ? error : "unknown");
+  pw_thread_loop_signal(loop, false);
+}
+
+static void on_param_changed(void *userdata, uint32_t id,
+                             const struct spa_pod *param) {
+  (void)userdata;
+  struct spa_audio_info_raw info;
+  if (!g_verbose || id != SPA_PARAM_Format || !param)
+    return;
+  if (spa_format_audio_raw_parse(param, &info) >= 0)
+    printf("PipeWire stream: negotiated %u Hz, %u channels\n", info.rate,
+           info.channels);
+}
+
+// Delay from the graph to the device, plus the quantum we render ahead.
+// Called with the loop locked or on the loop thread.
+static long stream_latency_us(void) {
+  struct pw_time t;
+  if (pw_stream_get_time_n(stream, &t, sizeof(t)) < 0 || t.rate.denom == 0)
+    return -1;
+  int64_t delay_us = t.delay * 1000000LL * t.rate.num / t.rate.denom;
+  delay_us += (int64_t)last_quantum * 1000000LL / ENGINE_SAMPLE_RATE;
+  return delay_us < 0 ? 0 : (long)delay_us;
+}
+
+// Invoked on the loop thread by on_process() whenever the graph hands us a
+// new quantum, so the data thread never prints
+static int report_quantum(struct spa_loop *l, bool async, uint32_t seq,
+                          const void *data, size_t size, void *user_data) {
+  (void)l;
+  (void)async;
+  (void)seq;
+  (void)size;
+  (void)user_data;
+  unsigned int quantum = *(const unsigned int *)data;
+  printf("PipeWire negotiated quantum: %u frames (%.2f ms), latency %ld us\n",
+         quantum, quantum * 1000.0 / ENGINE_SAMPLE_RATE, stream_latency_us());
+  return 0;
+}
+
+static void on_process(void *userdata) {
+  (void)userdata;
+  struct pw_buffer *b = pw_stream_dequeue_buffer(stream);
+  if (!b) {
+    // No free buffer means the graph consumed faster than we queued
+    underruns++;
+    return;
+  }
+  struct spa_data *d = &b->buffer->datas[0];
+  uint32_t frames = 0;
+  if (d->data) {
+    frames = d->maxsize / FRAME_BYTES;
+    if (b->requested && b->requested < frames)
+      frames = (uint32_t)b->requested;
+    render_fn((short *)d->data, (int)frames);
+    if (frames != last_quantum) {
+      last_quantum = frames;
+      if (g_verbose)
+        pw_loop_invoke(pw_thread_loop_get_loop(loop), report_quantum, 0,
+                       &frames, sizeof(frames), false, NULL);
+    }
+  }
+  d->chunk->offset = 0;
+  d->chunk->stride = FRAME_BYTES;
+  d->chunk->size = frames * FRAME_BYTES;
+  pw_stream_queue_buffer(stream, b);
+}
+
+static const struct pw_stream_events stream_events = {
+    PW_VERSION_STREAM_EVENTS,
+    .state_changed = on_state_changed,
+    .param_changed = on_param_changed,
+    .process = on_process,
+};
+
+static void pipewire_close(void);
+
+static int pipewire_open(const AudioSettings *audio, RenderFn render) {
+  render_fn = render;
+  underruns = 0;
+  last_quantum = 0;
+  pw_init(NULL, NULL);
+  loop = pw_thread_loop_new("vbx-pipewire", NULL);
+  if (!loop) {
+    fprintf(stderr, "Could not create PipeWire loop\n");
+    return -1;
+  }
+  char latency[32];
+  snprintf(latency, sizeof(latency), "%d/%d", audio->pipewire.quantum,
+           ENGINE_SAMPLE_RATE);
+  struct pw_properties *props = pw_properties_new(
+      PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_CATEGORY, "Playback",
+      PW_KEY_MEDIA_ROLE, "Accessibility", PW_KEY_NODE_LATENCY, latency, NULL);
+  pw_thread_loop_lock(loop);
+  if (pw_thread_loop_start(loop) < 0) {
+    fprintf(stderr, "Could not start PipeWire loop\n");
+    pw_thread_loop_unlock(loop);
+    pipewire_close();
+    return -1;
+  }
+  stream = pw_stream_new_simple(pw_thread_loop_get_loop(loop), "KeyboardSounds",
+                                props, &stream_events, NULL);
+  if (!stream) {
+    fprintf(stderr, "Could not create PipeWire stream\n");
+    pw_thread_loop_unlock(loop);
+    pipewire_close();
+    return -1;
+  }
+  uint8_t pod_buffer[1024];
+  struct spa_pod_builder builder =
+      SPA_POD_BUILDER_INIT(pod_buffer, sizeof(pod_buffer));
+  struct spa_audio_info_raw info = {.format = SPA_AUDIO_FORMAT_S16,
+                                    .rate = ENGINE_SAMPLE_RATE,
+                                    .channels = ENGINE_CHANNELS};
+  info.position[0] = SPA_AUDIO_CHANNEL_FL;
+  info.position[1] = SPA_AUDIO_CHANNEL_FR;
+  const struct spa_pod *params[1];
+  params[0] =
+      spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &info);
+  int flags = PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS |
+              PW_STREAM_FLAG_RT_PROCESS;
+  if (pw_stream_connect(stream, PW_DIRECTION_OUTPUT, PW_ID_ANY,
+                        (enum pw_stream_flags)flags, params, 1) < 0) {
+    fprintf(stderr, "Could not connect PipeWire stream\n");
+    pw_thread_loop_unlock(loop);
+    pipewire_close();
+    return -1;
+  }
+  while (stream_state != PW_STREAM_STATE_PAUSED &&
+         stream_state != PW_STREAM_STATE_STREAMING &&
+         stream_state != PW_STREAM_STATE_ERROR) {
+    if (pw_thread_loop_timed_wait(loop, CONNECT_TIMEOUT_S) != 0)
+      break;
+  }
+  int ok = stream_state == PW_STREAM_STATE_PAUSED ||
+           stream_state == PW_STREAM_STATE_STREAMING;
+  pw_thread_loop_unlock(loop);
+  if (!ok) {
+    fprintf(stderr, "Could not start PipeWire playback\n");
+    pipewire_close();
+    return -1;
+  }
+  if (g_verbose)
+    printf("PipeWire stream: requested quantum %s\n", latency);
+  return 0;
+}
+
+static long pipewire_latency_us(void) {
+  if (!stream)
+    return -1;
+  pw_thread_loop_lock(loop);
+  long latency_us = stream_latency_us();
+  pw_thread_loop_unlock(loop);
+  return latency_us;
+}
+
+static unsigned long pipewire_underruns(void) { return underruns; }
+
+static void pipewire_close(void) {
+  if (loop)
+    pw_thread_loop_stop(loop);
+  if (stream) {
+    pw_stream_destroy(stream);
+    stream = NULL;
+  }
+  if (loop) {
+    pw_thread_loop_destroy(loop);
+    loop = NULL;
+  }
+  stream_state = PW_STREAM_STATE_UNCONNECTED;
+  pw_deinit();
+}
+
+const AudioBackend pipewire_backend = {"pipewire",         pipewire_open,
+                                       NULL,               pipewire_latency_us,
+                                       pipewire_underruns, pipewire_close};
@@ -0,0 +1,192 @@
+#include "audio/backend.h"
+#include "audio/types.h"
+#include <pulse/pulseaudio.h>
+#include <stdio.h>
+
+#define FRAME_BYTES (ENGINE_CHANNELS * sizeof(short))
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_context *context = NULL;
+static pa_stream *stream = NULL;
+static RenderFn render_fn = NULL;
+static volatile unsigned long underruns = 0;
+
+static void context_state_cb(pa_context *c, void *userdata) {
+  (void)c;
+  (void)userdata;
+  pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void stream_state_cb(pa_stream *s, void *userdata) {
+  (void)s;
+  (void)userdata;
+  pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+// Render straight into the server's buffer so the mix is never copied
+static void stream_write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+  (void)userdata;
+  while (nbytes >= FRAME_BYTES) {
+    void *data = NULL;
+    size_t len = nbytes;
+    if (pa_stream_begin_write(s, &data, &len) < 0 || !data)
+      return;
+    size_t frames = len / FRAME_BYTES;
+    if (frames == 0) {
+      pa_stream_cancel_write(s);
+      return;
+    }
+    render_fn((short *)data, (int)frames);
+    if (pa_stream_write(s, data, frames * FRAME_BYTES, NULL, 0,
+                        PA_SEEK_RELATIVE) < 0)
+      return;
+    nbytes -= frames * FRAME_BYTES;
+  }
+}
+
+static void stream_underflow_cb(pa_stream *s, void *userdata) {
+  (void)s;
+  (void)userdata;
+  underruns++;
+}
+
+static uint32_t ms_to_bytes(double ms, const pa_sample_spec *ss) {
+  if (ms < 0)
+    return (uint32_t)-1;
+  return (uint32_t)pa_usec_to_bytes((pa_usec_t)(ms * 1000.0), ss);
+}
+
+static int wait_for_context(void) {
+  while (1) {
+    pa_context_state_t state = pa_context_get_state(context);
+    if (state == PA_CONTEXT_READY)
+      return 0;
+    if (!PA_CONTEXT_IS_GOOD(state))
+      return -1;
+    pa_threaded_mainloop_wait(mainloop);
+  }
+}
+
+static int wait_for_stream(void) {
+  while (1) {
+    pa_stream_state_t state = pa_stream_get_state(stream);
+    if (state == PA_STREAM_READY)
+      return 0;
+    if (!PA_STREAM_IS_GOOD(state))
+      return -1;
+    pa_threaded_mainloop_wait(mainloop);
+  }
+}
+
+static void pulse_close(void);
+
+static int pulse_open(const AudioSettings *audio, RenderFn render) {
+  const PulseSettings *settings = &audio->pulse;
+  render_fn = render;
+  mainloop = pa_threaded_mainloop_new();
+  if (!mainloop) {
+    fprintf(stderr, "Could not create PulseAudio mainloop\n");
+    return -1;
+  }
+  context =
+      pa_context_new(pa_threaded_mainloop_get_api(mainloop), "KeyboardSounds");
+  if (!context) {
+    fprintf(stderr, "Could not create PulseAudio context\n");
+    pulse_close();
+    return -1;
+  }
+  pa_context_set_state_callback(context, context_state_cb, NULL);
+  pa_threaded_mainloop_lock(mainloop);
+  if (pa_threaded_mainloop_start(mainloop) < 0 ||
+      pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0 ||
+      wait_for_context() < 0) {
+    fprintf(stderr, "Could not connect to PulseAudio: %s\n",
+            pa_strerror(pa_context_errno(context)));
+    pa_threaded_mainloop_unlock(mainloop);
+    pulse_close();
+    return -1;
+  }
+  pa_sample_spec ss = {.format = PA_SAMPLE_S16LE,
+                       .rate = ENGINE_SAMPLE_RATE,
+                       .channels = ENGINE_CHANNELS};
+  pa_buffer_attr attr = {.maxlength = (uint32_t)-1,
+                         .tlength = ms_to_bytes(settings->tlength_ms, &ss),
+                         .prebuf = ms_to_bytes(settings->prebuf_ms, &ss),
+                         .minreq = ms_to_bytes(settings->minreq_ms, &ss),
+                         .fragsize = (uint32_t)-1};
+  int flags = PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE;
+  if (settings->adjust_latency)
+    flags |= PA_STREAM_ADJUST_LATENCY;
+  if (settings->early_requests)
+    flags |= PA_STREAM_EARLY_REQUESTS;
+  stream = pa_stream_new(context, "playback", &ss, NULL);
+  if (!stream) {
+    fprintf(stderr, "Could not create PulseAudio stream: %s\n",
+            pa_strerror(pa_context_errno(context)));
+    pa_threaded_mainloop_unlock(mainloop);
+    pulse_close();
+    return -1;
+  }
+  pa_stream_set_state_callback(stream, stream_state_cb, NULL);
+  pa_stream_set_write_callback(stream, stream_write_cb, NULL);
+  pa_stream_set_underflow_callback(stream, stream_underflow_cb, NULL);
+  if (pa_stream_connect_playback(stream, NULL, &attr,
+                                 (pa_stream_flags_t)flags, NULL, NULL) < 0 ||
+      wait_for_stream() < 0) {
+    fprintf(stderr, "Could not start PulseAudio playback: %s\n",
+            pa_strerror(pa_context_errno(context)));
+    pa_threaded_mainloop_unlock(mainloop);
+    pulse_close();
+    return -1;
+  }
+  const pa_buffer_attr *got = pa_stream_get_buffer_attr(stream);
+  if (g_verbose && got) {
+    printf("PulseAudio buffer: tlength %.1f ms, minreq %.1f ms, prebuf %.1f "
+           "ms\n",
+           pa_bytes_to_usec(got->tlength, &ss) / 1000.0,
+           pa_bytes_to_usec(got->minreq, &ss) / 1000.0,
+           pa_bytes_to_usec(got->prebuf, &ss) / 1000.0);
+  }
+  pa_threaded_mainloop_unlock(mainloop);
+  return 0;
+}
+
+static long pulse_latency_us(void) {
+  if (!stream)
+    return -1;
+  pa_usec_t latency = 0;
+  int negative = 0;
+  pa_threaded_mainloop_lock(mainloop);
+  int rc = pa_stream_get_latency(stream, &latency, &negative);
+  pa_threaded_mainloop_unlock(mainloop);
+  if (rc < 0)
+    return -1;
+  return negative ? 0 : (long)latency;
+}
+
+static unsigned long pulse_underruns(void) { return underruns; }
+
+static void pulse_close(void) {
+  if (mainloop && stream) {
+    pa_threaded_mainloop_lock(mainloop);
+    pa_stream_disconnect(stream);
+    pa_stream_unref(stream);
+    stream = NULL;
+    pa_threaded_mainloop_unlock(mainloop);
+  }
+  if (mainloop)
+    pa_threaded_mainloop_stop(mainloop);
+  if (context) {
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+    context = NULL;
+  }
+  if (mainloop) {
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+  }
+}
+
+const AudioBackend pulse_backend = {"pulse",         pulse_open,
+                                    NULL,            pulse_latency_us,
+                                    pulse_underruns, pulse_close};
@@ -0,0 +1,53 @@
+#include "audio/backend.h"
+#include "audio/types.h"
+#include <sndfile.h>
+#include <stdio.h>
+
+// Records the engine output to a 16-bit WAV file at real-time pace
+
+static SNDFILE *wav_file = NULL;
+static BackendClock wav_clock;
+
+static int wav_open(const AudioSettings *settings, RenderFn render) {
+  (void)render;
+  SF_INFO info = {0};
+  info.samplerate = ENGINE_SAMPLE_RATE;
+  info.channels = ENGINE_CHANNELS;
+  info.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+  wav_file = sf_open(settings->wav_path, SFM_WRITE, &info);
+  if (!wav_file) {
+    fprintf(stderr, "Could not open WAV output %s: %s\n", settings->wav_path,
+            sf_strerror(NULL));
+    return -1;
+  }
+  wav_clock = (BackendClock){0};
+  if (g_verbose)
+    printf("Writing audio to %s\n", settings->wav_path);
+  return 0;
+}
+
+static int wav_write(const short *frames, int count) {
+  if (sf_writef_short(wav_file, frames, count) != count) {
+    fprintf(stderr, "WAV write error: %s\n", sf_strerror(wav_file));
+    return -1;
+  }
+  backend_clock_wait(&wav_clock, count);
+  return 0;
+}
+
+static long wav_latency_us(void) {
+  return MIXER_PERIOD_FRAMES * 1000000L / ENGINE_SAMPLE_RATE;
+}
+
+static unsigned long wav_underruns(void) { return wav_clock.late; }
+
+static void wav_close(void) {
+  if (wav_file) {
+    sf_close(wav_file);
+    wav_file = NULL;
+  }
+}
+
+const AudioBackend wav_backend = {"wav",         wav_open,
+                                  wav_write,     wav_latency_us,
+                                  wav_underruns, wav_close};
@@ -1,15 +1,16 @@
+#include "audio/pack.h"
+#include "audio/soundpack.h"
 #include "audio/types.h"
 #include "common/utils.h"
 #include <errno.h>
 #include <json-c/json.h>
 #include <libgen.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-SoundPack g_sound_pack = {0};
-SoundPack g_mouse_sound_pack = {0};
 float g_volume = 1.0f;
 float g_mouse_volume = 1.0f;
 int g_verbose = 0;
@@ -33,7 +34,133 @@ static void get_full_path(char *buffer, size_t buffer_size,
 }
 
 
-int load_sound_config(const char *config_path) {
+// Key code of a "defines" or "definitions" name; "<code>-up" names the
+// key's release
+static int parse_key_name(const char *key, int *is_release) {
+  *is_release = strstr(key, "-up") != NULL;
+  if (strcmp(key, "MouseLeft") == 0)
+    return 272;
+  if (strcmp(key, "MouseRight") == 0)
+    return 273;
+  if (strcmp(key, "MouseMiddle") == 0)
+    return 274;
+  return atoi(key);
+}
+
+static int set_key_bank(SoundPack *pack, int key_code, int is_release,
+                        const int *sounds, int count) {
+  if (count == 0)
+    return 0;
+  int bank = sound_pack_add_bank(pack, sounds, count);
+  if (bank == NO_SOUND)
+    return -1;
+  return sound_pack_set_key(pack, key_code, is_release, bank);
+}
+
+static int add_multi_file(SoundPack *pack, const char *config_dir,
+                          json_object *name, int *sounds, int *count) {
+  char path[1024];
+  get_full_path(path, sizeof(path), config_dir, json_object_get_string(name));
+  if (!path[0])
+    return 0;
+  if (*count == SOUND_PACK_MAX_VARIANTS) {
+    safe_fprintf(stderr,
+                 "Warning: A key has more than %d sounds; ignoring %s\n",
+                 SOUND_PACK_MAX_VARIANTS, path);
+    return 0;
+  }
+  int sound = sound_pack_add_file(pack, path);
+  if (sound == NO_SOUND)
+    return -1;
+  sounds[(*count)++] = sound;
+  return 0;
+}
+
+// A [start, duration] (or with `end_form`, [start, end]) range in ms of the
+// single-mode sound file
+static int add_segment(SoundPack *pack, json_object *segment, int end_form,
+                       int *sounds, int *count) {
+  if (!json_object_is_type(segment, json_type_array) ||
+      json_object_array_length(segment) < 2)
+    return 0;
+  int start = json_object_get_int(json_object_array_get_idx(segment, 0));
+  int length = json_object_get_int(json_object_array_get_idx(segment, 1));
+  if (end_form)
+    length -= start;
+  if (length <= 0)
+    return 0;
+  if (*count == SOUND_PACK_MAX_VARIANTS) {
+    safe_fprintf(stderr,
+                 "Warning: A key has more than %d sounds; ignoring the one "
+                 "at %d ms\n",
+                 SOUND_PACK_MAX_VARIANTS, start);
+    return 0;
+  }
+  int sound = sound_pack_add_range(pack, start, length);
+  if (sound == NO_SOUND)
+    return -1;
+  sounds[(*count)++] = sound;
+  return 0;
+}
+
+// Generic press files of a multi pack. "{a-b}" in the pattern stands for
+// every number from a to b, skipping missing files, and "%d" for 0, 1, ...
+// up to the first missing one. Files past SOUND_PACK_MAX_VARIANTS are
+// left out with a warning. Returns how many were added to `sounds`.
+static int add_generic_files(SoundPack *pack, const char *config_dir,
+                             const char *pattern, int *sounds) {
+  const char *open = strchr(pattern, '{');
+  const char *close = open ? strchr(open, '}') : NULL;
+  const char *split = NULL, *rest = NULL;
+  int first = 0, last = INT_MAX - 1, skip_missing = 0;
+  if (open && close) {
+    int a, b;
+    if (sscanf(open, "{%d-%d}", &a, &b) == 2 && a >= 0 && b >= a) {
+      first = a;
+      last = b;
+      skip_missing = 1;
+    }
+    split = open;
+    rest = close + 1;
+  } else if ((split = strstr(pattern, "%d")) != NULL) {
+    rest = split + 2;
+  }
+  int count = 0;
+  for (int i = first; i <= last; i++) {
+    char name[512], path[1024];
+    if (split) {
+      if (!safe_snprintf(name, sizeof(name), "%.*s%d%s",
+                         (int)(split - pattern), pattern, i, rest))
+        break;
+    } else {
+      safe_strncpy(name, pattern, sizeof(name));
+    }
+    get_full_path(path, sizeof(path), config_dir, name);
+    if (access(path, R_OK) != 0) {
+      if (g_verbose)
+        printf("Generic sound file not found: %s\n", path);
+      if (skip_missing)
+        continue;
+      break;
+    }
+    if (count == SOUND_PACK_MAX_VARIANTS) {
+      safe_fprintf(stderr,
+                   "Warning: %s matches more than %d files; using the "
+                   "first %d\n",
+                   pattern, SOUND_PACK_MAX_VARIANTS, SOUND_PACK_MAX_VARIANTS);
+      break;
+    }
+    int sound = sound_pack_add_file(pack, path);
+    if (sound == NO_SOUND)
+      return -1;
+    sounds[count++] = sound;
+    if (!split)
+      break;
+  }
+  return count;
+}
+
+int load_sound_config(SoundPack *pack, const char *config_path) {
   FILE *file = fopen(config_path, "r");
   if (!file) {
     safe_fprintf(stderr, "Error: Cannot open sound pack config: %s\n", config_path);
@@ -77,168 +204,124 @@ int load_sound_config(const char *config_path) {
   json_object *obj;
   if (json_object_object_get_ex(root, "key_define_type", &obj))
     key_type = json_object_get_string(obj);
-  g_sound_pack.is_multi = strcmp(key_type, "multi") == 0;
+  pack->is_multi = strcmp(key_type, "multi") == 0;
   if (g_verbose) {
     printf("Config loaded: Using %s mode\n",
-           g_sound_pack.is_multi ? "multi" : "single");
+           pack->is_multi ? "multi" : "single");
   }
-  if (g_sound_pack.is_multi) {
-    g_sound_pack.num_generic_press_files = 0;
+  int rc = 0;
+  if (pack->is_multi) {
     if (json_object_object_get_ex(root, "sound", &obj)) {
       const char *pattern = json_object_get_string(obj);
       if (g_verbose)
         printf("Sound pattern: %s\n", pattern);
-      if (strstr(pattern, "%d") || strstr(pattern, "{")) {
-        for (int i = 0; i <= 4; i++) {
-          char temp_filename[256];
-          if (strstr(pattern, "{")) {
-            char temp_pattern[256];
-            safe_strncpy(temp_pattern, pattern, sizeof(temp_pattern));
-            char *brace_start = strstr(temp_pattern, "{");
-            char *brace_end = strstr(temp_pattern, "}");
-            if (brace_start && brace_end) {
-              *brace_start = '%';
-              *(brace_start + 1) = 'd';
-              safe_memmove(brace_start + 2, brace_end + 1,
-                      strlen(brace_end + 1) + 1);
-            }
-            safe_snprintf_wrapper(temp_filename, sizeof(temp_filename), temp_pattern, i);
-          } else {
-            safe_snprintf_wrapper(temp_filename, sizeof(temp_filename), pattern, i);
-          }
-          get_full_path(g_sound_pack.generic_press_files[i],
-                        sizeof(g_sound_pack.generic_press_files[i]), config_dir,
-                        temp_filename);
-          if (access(g_sound_pack.generic_press_files[i], R_OK) == 0) {
-            g_sound_pack.num_generic_press_files = i + 1;
-          } else {
-            if (g_verbose)
-              printf("Generic sound file not found: %s\n",
-                     g_sound_pack.generic_press_files[i]);
-            break;
-          }
-        }
-      } else {
-        get_full_path(g_sound_pack.generic_press_files[0],
-                      sizeof(g_sound_pack.generic_press_files[0]), config_dir,
-                      pattern);
-        if (access(g_sound_pack.generic_press_files[0], R_OK) == 0) {
-          g_sound_pack.num_generic_press_files = 1;
-          if (g_verbose)
-            printf("Found single generic sound file: %s\n",
-                   g_sound_pack.generic_press_files[0]);
-        }
-      }
+      int sounds[SOUND_PACK_MAX_VARIANTS];
+      int count = add_generic_files(pack, config_dir, pattern, sounds);
+      if (count < 0)
+        rc = -1;
+      else if (count > 0 &&
+               (pack->generic_press = sound_pack_add_bank(pack, sounds,
+                                                          count)) == NO_SOUND)
+        rc = -1;
       if (g_verbose)
-        printf("Total generic press sound files: %d\n",
-               g_sound_pack.num_generic_press_files);
+        printf("Total generic press sound files: %d\n", count > 0 ? count : 0);
     }
     if (json_object_object_get_ex(root, "soundup", &obj)) {
-      char temp_release_file[256];
-      safe_strncpy(temp_release_file, json_object_get_string(obj),
-              sizeof(temp_release_file));
-      get_full_path(g_sound_pack.release_file,
-                    sizeof(g_sound_pack.release_file), config_dir,
-                    temp_release_file);
+      char release_file[1024];
+      get_full_path(release_file, sizeof(release_file), config_dir,
+                    json_object_get_string(obj));
+      if (release_file[0]) {
+        int sound = sound_pack_add_file(pack, release_file);
+        if (sound == NO_SOUND ||
+            (pack->release = sound_pack_add_bank(pack, &sound, 1)) == NO_SOUND)
+          rc = -1;
+      }
       if (g_verbose)
-        printf("Release sound file: %s\n", g_sound_pack.release_file);
+        printf("Release sound file: %s\n", release_file);
     }
     if (json_object_object_get_ex(root, "defines", &obj)) {
       json_object_object_foreach(obj, key, val) {
-        int key_code;
-        int is_release = 0;
-        if (strcmp(key, "MouseLeft") == 0) {
-          key_code = 272;
-        } else if (strcmp(key, "MouseRight") == 0) {
-          key_code = 273;
-        } else if (strcmp(key, "MouseMiddle") == 0) {
-          key_code = 274;
+        int is_release;
+        int key_code = parse_key_name(key, &is_release);
+        if (key_code < 0 || key_code >= SOUND_PACK_KEYS)
+          continue;
+        // A file, or a list of files to vary between
+        int sounds[SOUND_PACK_MAX_VARIANTS];
+        int count = 0;
+        if (json_object_is_type(val, json_type_array)) {
+          int n = (int)json_object_array_length(val);
+          for (int i = 0; rc == 0 && i < n; i++)
+            rc = add_multi_file(pack, config_dir,
+                                json_object_array_get_idx(val, i), sounds,
+                                &count);
         } else {
-          char *dash = strstr(key, "-up");
-          if (dash) {
-            char key_copy[16];
-            safe_strncpy(key_copy, key, dash - key + 1);
-            key_copy[dash - key] = '\0';
-            key_code = atoi(key_copy);
-            is_release = 1;
-          } else {
-            key_code = atoi(key);
-          }
-        }
-        if (key_code >= 0 && key_code < 512) {
-          const char *filename_relative = json_object_get_string(val);
-          char full_filename[1024];
-          get_full_path(full_filename, sizeof(full_filename), config_dir,
-                        filename_relative);
-          if (is_release) {
-            if (g_sound_pack.multi_key_mappings[key_code].release)
-              free(g_sound_pack.multi_key_mappings[key_code].release);
-            g_sound_pack.multi_key_mappings[key_code].release =
-                xstrdup(full_filename);
-          } else {
-            if (g_sound_pack.multi_key_mappings[key_code].press)
-              free(g_sound_pack.multi_key_mappings[key_code].press);
-            g_sound_pack.multi_key_mappings[key_code].press =
-                xstrdup(full_filename);
-          }
+          rc |= add_multi_file(pack, config_dir, val, sounds, &count);
         }
+        if (rc == 0)
+          rc = set_key_bank(pack, key_code, is_release, sounds, count);
       }
     }
   } else {
     if (json_object_object_get_ex(root, "sound", &obj) ||
         json_object_object_get_ex(root, "audio_file", &obj)) {
-      char temp_sound_file[256];
-      safe_strncpy(temp_sound_file, json_object_get_string(obj),
-              sizeof(temp_sound_file));
-      get_full_path(g_sound_pack.sound_file, sizeof(g_sound_pack.sound_file),
-                    config_dir, temp_sound_file);
+      char sound_file[1024];
+      get_full_path(sound_file, sizeof(sound_file), config_dir,
+                    json_object_get_string(obj));
+      pack->sound_file = sound_pack_intern(pack, sound_file);
+      if (pack->sound_file < 0)
+        rc = -1;
       if (g_verbose)
-        printf("Single mode sound file: %s\n", g_sound_pack.sound_file);
+        printf("Single mode sound file: %s\n", sound_file);
     }
     json_object *defines_obj = NULL;
     if (json_object_object_get_ex(root, "defines", &defines_obj) ||
         json_object_object_get_ex(root, "definitions", &defines_obj)) {
       json_object_object_foreach(defines_obj, key, val) {
-        int key_code;
-        if (strcmp(key, "MouseLeft") == 0) {
-          key_code = 272;
-        } else if (strcmp(key, "MouseRight") == 0) {
-          key_code = 273;
-        } else if (strcmp(key, "MouseMiddle") == 0) {
-          key_code = 274;
-        } else {
-          key_code = atoi(key);
-        }
-        if (key_code >= 0 && key_code < 512) {
-          if (json_object_is_type(val, json_type_array)) {
-            if (json_object_array_length(val) >= 2) {
-              g_sound_pack.key_mappings[key_code].start_ms =
-                  json_object_get_int(json_object_array_get_idx(val, 0));
-              g_sound_pack.key_mappings[key_code].duration_ms =
-                  json_object_get_int(json_object_array_get_idx(val, 1));
-            }
-          } else if (json_object_is_type(val, json_type_object)) {
-            json_object *timing_array;
-            if (json_object_object_get_ex(val, "timing", &timing_array) &&
-                json_object_is_type(timing_array, json_type_array) &&
-                json_object_array_length(timing_array) > 0) {
-              json_object *first_timing =
-                  json_object_array_get_idx(timing_array, 0);
-              if (json_object_is_type(first_timing, json_type_array) &&
-                  json_object_array_length(first_timing) >= 2) {
-                g_sound_pack.key_mappings[key_code].start_ms =
-                    json_object_get_int(
-                        json_object_array_get_idx(first_timing, 0));
-                g_sound_pack.key_mappings[key_code].duration_ms =
-                    json_object_get_int(
-                        json_object_array_get_idx(first_timing, 1));
-              }
-            }
+        int is_release;
+        int key_code = parse_key_name(key, &is_release);
+        if (key_code < 0 || key_code >= SOUND_PACK_KEYS)
+          continue;
+        int press[SOUND_PACK_MAX_VARIANTS], release[SOUND_PACK_MAX_VARIANTS];
+        int num_press = 0, num_release = 0;
+        json_object *timing;
+        if (json_object_is_type(val, json_type_array)) {
+          // Version 1: [start, duration], or a list of them to vary between
+          int *sounds = is_release ? release : press;
+          int *count = is_release ? &num_release : &num_press;
+          if (json_object_array_length(val) > 0 &&
+              json_object_is_type(json_object_array_get_idx(val, 0),
+                                  json_type_array)) {
+            int n = (int)json_object_array_length(val);
+            for (int i = 0; rc == 0 && i < n; i++)
+              rc = add_segment(pack, json_object_array_get_idx(val, i), 0,
+                               sounds, count);
+          } else {
+            rc = add_segment(pack, val, 0, sounds, count);
           }
+        } else if (json_object_is_type(val, json_type_object) &&
+                   json_object_object_get_ex(val, "timing", &timing) &&
+                   json_object_is_type(timing, json_type_array)) {
+          // Version 2: [start, end] segments alternating between key down
+          // and key up
+          int n = (int)json_object_array_length(timing);
+          for (int i = 0; rc == 0 && i < n; i++)
+            rc = add_segment(pack, json_object_array_get_idx(timing, i), 1,
+                             i % 2 ? release : press,
+                             i % 2 ? &num_release : &num_press);
         }
+        if (rc == 0)
+          rc = set_key_bank(pack, key_code, 0, press, num_press);
+        if (rc == 0)
+          rc = set_key_bank(pack, key_code, 1, release, num_release);
       }
     }
   }
+  json_object *options;
+  if (json_object_object_get_ex(root, "options", &options) &&
+      json_object_object_get_ex(options, "random_pitch", &obj))
+    pack->random_pitch = json_object_get_boolean(obj);
   json_object_put(root);
-  return 0;
+  if (rc != 0)
+    safe_fprintf(stderr, "Error: Memory allocation failed\n");
+  return rc;
 }
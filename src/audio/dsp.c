@@ -0,0 +1,323 @@
+#include "audio/dsp.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VBX_DSP_X86 1
+#include <immintrin.h>
+#endif
+
+// Round half to even, matching cvtps2dq, so every variant is bit-identical.
+// Adding 1.5 * 2^23 pushes the fraction out of the mantissa.
+static short saturate_s16(float s) {
+  if (s >= 32767.0f)
+    return 32767;
+  if (s <= -32768.0f)
+    return -32768;
+  float shifted = s + 12582912.0f;
+  return (short)(shifted - 12582912.0f);
+}
+
+static int accumulate_scalar(float *accum, const short *src, int samples,
+                             float gain) {
+  int peak = 0;
+  for (int i = 0; i < samples; i++) {
+    int s = src[i];
+    int magnitude = s < 0 ? (s == -32768 ? 32767 : -s) : s;
+    if (magnitude > peak)
+      peak = magnitude;
+    accum[i] += s * gain;
+  }
+  return peak;
+}
+
+static int accumulate_mono_scalar(float *accum, const short *src, int frames,
+                                  float gain) {
+  int peak = 0;
+  for (int i = 0; i < frames; i++) {
+    int s = src[i];
+    int magnitude = s < 0 ? (s == -32768 ? 32767 : -s) : s;
+    if (magnitude > peak)
+      peak = magnitude;
+    float scaled = s * gain;
+    accum[2 * i] += scaled;
+    accum[2 * i + 1] += scaled;
+  }
+  return peak;
+}
+
+static void to_s16_scalar(short *dst, const float *src, int samples) {
+  for (int i = 0; i < samples; i++)
+    dst[i] = saturate_s16(src[i]);
+}
+
+static void gain_s16_scalar(short *dst, const short *src, int samples,
+                            float gain) {
+  for (int i = 0; i < samples; i++)
+    dst[i] = saturate_s16(src[i] * gain);
+}
+
+// The dot kernels keep eight partial sums and fold them in this fixed order,
+// so the vector variants round exactly like the scalar one
+static float reduce_lanes(const float *lanes) {
+  return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) +
+         ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+}
+
+static float dot_scalar(const float *a, const float *b, int n) {
+  float lanes[8] = {0};
+  for (int i = 0; i < n; i += 8) {
+    for (int l = 0; l < 8; l++)
+      lanes[l] += a[i + l] * b[i + l];
+  }
+  return reduce_lanes(lanes);
+}
+
+#ifdef VBX_DSP_X86
+
+// Each variant is compiled for its own instruction set, so the file builds
+// for i386 without -msse2 too; dsp_init() only picks what the CPU runs
+#define SSE2 __attribute__((target("sse2")))
+
+// Saturating abs: -32768 maps to 32767 as in the scalar code. SSE2 has no
+// 16-bit abs and pabsw would leave -32768 negative.
+SSE2 static __m128i abs_epi16_sse2(__m128i v) {
+  return _mm_max_epi16(v, _mm_subs_epi16(_mm_setzero_si128(), v));
+}
+
+SSE2 static int hmax_epi16_sse2(__m128i v) {
+  v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_max_epi16(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return (unsigned short)_mm_extract_epi16(v, 0);
+}
+
+// Sign-extend 8 S16 samples to two vectors of 4 floats
+SSE2 static void s16_to_ps_sse2(__m128i v, __m128 *lo, __m128 *hi) {
+  *lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+  *hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+
+SSE2 static int accumulate_sse2(float *accum, const short *src, int samples,
+                                float gain) {
+  __m128 g = _mm_set1_ps(gain);
+  __m128i peak = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    peak = _mm_max_epi16(peak, abs_epi16_sse2(v));
+    __m128 lo, hi;
+    s16_to_ps_sse2(v, &lo, &hi);
+    _mm_storeu_ps(accum + i,
+                  _mm_add_ps(_mm_loadu_ps(accum + i), _mm_mul_ps(lo, g)));
+    _mm_storeu_ps(accum + i + 4,
+                  _mm_add_ps(_mm_loadu_ps(accum + i + 4), _mm_mul_ps(hi, g)));
+  }
+  int tail = accumulate_scalar(accum + i, src + i, samples - i, gain);
+  int vpeak = hmax_epi16_sse2(peak);
+  return tail > vpeak ? tail : vpeak;
+}
+
+SSE2 static int accumulate_mono_sse2(float *accum, const short *src,
+                                     int frames, float gain) {
+  __m128 g = _mm_set1_ps(gain);
+  __m128i peak = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    peak = _mm_max_epi16(peak, abs_epi16_sse2(v));
+    __m128 halves[2];
+    s16_to_ps_sse2(v, &halves[0], &halves[1]);
+    float *out = accum + 2 * i;
+    for (int h = 0; h < 2; h++) {
+      __m128 f = _mm_mul_ps(halves[h], g);
+      __m128 a = _mm_unpacklo_ps(f, f);
+      __m128 b = _mm_unpackhi_ps(f, f);
+      _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), a));
+      _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), b));
+      out += 8;
+    }
+  }
+  int tail =
+      accumulate_mono_scalar(accum + 2 * i, src + i, frames - i, gain);
+  int vpeak = hmax_epi16_sse2(peak);
+  return tail > vpeak ? tail : vpeak;
+}
+
+SSE2 static void to_s16_sse2(short *dst, const float *src, int samples) {
+  __m128 max = _mm_set1_ps(32767.0f);
+  __m128 min = _mm_set1_ps(-32768.0f);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), min), max);
+    __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), min), max);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128((__m128i *)(dst + i), packed);
+  }
+  to_s16_scalar(dst + i, src + i, samples - i);
+}
+
+SSE2 static void gain_s16_sse2(short *dst, const short *src, int samples,
+                               float gain) {
+  __m128 g = _mm_set1_ps(gain);
+  int i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128 lo, hi;
+    s16_to_ps_sse2(_mm_loadu_si128((const __m128i *)(src + i)), &lo, &hi);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(lo, g)),
+                                     _mm_cvtps_epi32(_mm_mul_ps(hi, g)));
+    _mm_storeu_si128((__m128i *)(dst + i), packed);
+  }
+  gain_s16_scalar(dst + i, src + i, samples - i, gain);
+}
+
+SSE2 static float dot_sse2(const float *a, const float *b, int n) {
+  __m128 lo = _mm_setzero_ps();
+  __m128 hi = _mm_setzero_ps();
+  for (int i = 0; i < n; i += 8) {
+    lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(a + i + 4),
+                                   _mm_loadu_ps(b + i + 4)));
+  }
+  float lanes[8];
+  _mm_storeu_ps(lanes, lo);
+  _mm_storeu_ps(lanes + 4, hi);
+  return reduce_lanes(lanes);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static int hmax_epi16_avx2(__m256i v) {
+  __m128i m = _mm_max_epi16(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  return hmax_epi16_sse2(m);
+}
+
+AVX2 static int accumulate_avx2(float *accum, const short *src, int samples,
+                                float gain) {
+  __m256 g = _mm256_set1_ps(gain);
+  __m256i peak = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    peak = _mm256_max_epi16(
+        peak, _mm256_max_epi16(v, _mm256_subs_epi16(_mm256_setzero_si256(), v)));
+    __m256 lo = _mm256_cvtepi32_ps(
+        _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+    __m256 hi = _mm256_cvtepi32_ps(
+        _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+    _mm256_storeu_ps(accum + i, _mm256_add_ps(_mm256_loadu_ps(accum + i),
+                                              _mm256_mul_ps(lo, g)));
+    _mm256_storeu_ps(accum + i + 8,
+                     _mm256_add_ps(_mm256_loadu_ps(accum + i + 8),
+                                   _mm256_mul_ps(hi, g)));
+  }
+  int tail = accumulate_sse2(accum + i, src + i, samples - i, gain);
+  int vpeak = hmax_epi16_avx2(peak);
+  return tail > vpeak ? tail : vpeak;
+}
+
+AVX2 static int accumulate_mono_avx2(float *accum, const short *src,
+                                     int frames, float gain) {
+  __m256 g = _mm256_set1_ps(gain);
+  __m128i peak = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    peak = _mm_max_epi16(peak, abs_epi16_sse2(v));
+    __m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v)), g);
+    // unpack works per 128-bit lane, so reassemble the duplicated pairs
+    __m256 lo = _mm256_unpacklo_ps(f, f);
+    __m256 hi = _mm256_unpackhi_ps(f, f);
+    float *out = accum + 2 * i;
+    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_loadu_ps(out),
+                                        _mm256_permute2f128_ps(lo, hi, 0x20)));
+    _mm256_storeu_ps(out + 8,
+                     _mm256_add_ps(_mm256_loadu_ps(out + 8),
+                                   _mm256_permute2f128_ps(lo, hi, 0x31)));
+  }
+  int tail =
+      accumulate_mono_scalar(accum + 2 * i, src + i, frames - i, gain);
+  int vpeak = hmax_epi16_sse2(peak);
+  return tail > vpeak ? tail : vpeak;
+}
+
+// packs_epi32 interleaves the two 128-bit lanes; permute restores order
+AVX2 static __m256i pack_ps_to_s16_avx2(__m256 a, __m256 b) {
+  __m256i packed =
+      _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+  return _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+AVX2 static void to_s16_avx2(short *dst, const float *src, int samples) {
+  __m256 max = _mm256_set1_ps(32767.0f);
+  __m256 min = _mm256_set1_ps(-32768.0f);
+  int i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256 a =
+        _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), min), max);
+    __m256 b =
+        _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), min), max);
+    _mm256_storeu_si256((__m256i *)(dst + i), pack_ps_to_s16_avx2(a, b));
+  }
+  to_s16_sse2(dst + i, src + i, samples - i);
+}
+
+AVX2 static void gain_s16_avx2(short *dst, const short *src, int samples,
+                               float gain) {
+  __m256 g = _mm256_set1_ps(gain);
+  int i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256 lo = _mm256_cvtepi32_ps(
+        _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+    __m256 hi = _mm256_cvtepi32_ps(
+        _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+    _mm256_storeu_si256(
+        (__m256i *)(dst + i),
+        pack_ps_to_s16_avx2(_mm256_mul_ps(lo, g), _mm256_mul_ps(hi, g)));
+  }
+  gain_s16_sse2(dst + i, src + i, samples - i, gain);
+}
+
+AVX2 static float dot_avx2(const float *a, const float *b, int n) {
+  __m256 acc = _mm256_setzero_ps();
+  for (int i = 0; i < n; i += 8)
+    acc = _mm256_add_ps(
+        acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  float lanes[8];
+  _mm256_storeu_ps(lanes, acc);
+  return reduce_lanes(lanes);
+}
+
+#endif // VBX_DSP_X86
+
+static const DspKernels all_variants[] = {
+    {"scalar", accumulate_scalar, accumulate_mono_scalar, to_s16_scalar,
+     gain_s16_scalar, dot_scalar},
+#ifdef VBX_DSP_X86
+    {"sse2", accumulate_sse2, accumulate_mono_sse2, to_s16_sse2,
+     gain_s16_sse2, dot_sse2},
+    {"avx2", accumulate_avx2, accumulate_mono_avx2, to_s16_avx2,
+     gain_s16_avx2, dot_avx2},
+#endif
+};
+
+DspKernels g_dsp = {"scalar",      accumulate_scalar, accumulate_mono_scalar,
+                    to_s16_scalar, gain_s16_scalar,   dot_scalar};
+
+static int num_supported_variants(void) {
+#ifdef VBX_DSP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return 3;
+  if (__builtin_cpu_supports("sse2"))
+    return 2;
+#endif
+  return 1;
+}
+
+void dsp_init(void) { g_dsp = all_variants[num_supported_variants() - 1]; }
+
+const DspKernels *dsp_variants(int *count) {
+  *count = num_supported_variants();
+  return all_variants;
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/event_reader.h"
+#include "audio/log.h"
+#include "audio/playback.h"
+#include "common/event_record.h"
+#include "common/trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void event_reader_init(EventReader *r) {
+  r->start = 0;
+  r->used = 0;
+  r->warned_version = 0;
+}
+
+ssize_t event_reader_fill(EventReader *r, int fd) {
+  if (r->start > 0) {
+    memmove(r->data, r->data + r->start, r->used - r->start);
+    r->used -= r->start;
+    r->start = 0;
+  }
+  // A line that fills the whole buffer is no event; drop it
+  if (r->used == sizeof(r->data) - 1) {
+    fprintf(stderr, "Warning: Discarding %zu bytes of input without a "
+                    "newline\n",
+            r->used);
+    r->used = 0;
+  }
+  // One byte is kept for terminating a JSON line
+  ssize_t n = read(fd, r->data + r->used, sizeof(r->data) - 1 - r->used);
+  if (n > 0)
+    r->used += (size_t)n;
+  return n;
+}
+
+void event_reader_finish(EventReader *r) {
+  // A partial binary record stays incomplete; fill() keeps a byte free
+  if (r->start < r->used &&
+      (unsigned char)r->data[r->start] != EVENT_RECORD_MAGIC &&
+      r->data[r->used - 1] != '\n')
+    r->data[r->used++] = '\n';
+}
+
+static int next_record(EventReader *r, int *key_code, int *is_pressed,
+                       EventTimes *times) {
+  EventRecord record;
+  if (r->used - r->start < sizeof(record))
+    return 0;
+  memcpy(&record, r->data + r->start, sizeof(record));
+  r->start += sizeof(record);
+  if (record.version != EVENT_RECORD_VERSION ||
+      record.device > EVENT_DEVICE_POINTER) {
+    if (!r->warned_version) {
+      r->warned_version = 1;
+      fprintf(stderr, "Warning: Ignoring events of protocol version %d, "
+                      "expected %d; vbx-input and vbx-audio are from "
+                      "different builds\n",
+              record.version, EVENT_RECORD_VERSION);
+    }
+    return -1;
+  }
+  *key_code = (int)record.code;
+  *is_pressed = record.pressed;
+  times->event_us = record.time_us;
+  times->sent_us = record.sent_us;
+  return 1;
+}
+
+static int next_line(EventReader *r, int *key_code, int *is_pressed,
+                     EventTimes *times) {
+  char *line = r->data + r->start;
+  char *newline = memchr(line, '\n', r->used - r->start);
+  if (!newline)
+    return 0;
+  *newline = '\0';
+  r->start = (size_t)(newline + 1 - r->data);
+  return parse_keyboard_event(line, key_code, is_pressed, times) == 0 ? 1
+                                                                      : -1;
+}
+
+int event_reader_next(EventReader *r, int *key_code, int *is_pressed,
+                      EventTimes *times) {
+  while (r->start < r->used) {
+    memset(times, 0, sizeof(*times));
+    int got = (unsigned char)r->data[r->start] == EVENT_RECORD_MAGIC
+                  ? next_record(r, key_code, is_pressed, times)
+                  : next_line(r, key_code, is_pressed, times);
+    if (got >= 0)
+      return got;
+  }
+  return 0;
+}
+
+void event_reader_queue(EventReader *r) {
+  uint64_t received_us = latency_now_us();
+  VBX_PROBE1(event_receive, received_us);
+  EventTimes times;
+  int key_code, is_pressed;
+  while (event_reader_next(r, &key_code, &is_pressed, &times)) {
+    times.received_us = received_us;
+    times.parsed_us = latency_now_us();
+    VBX_PROBE4(event_parse, key_code, is_pressed, times.event_us,
+               times.parsed_us);
+    if (queue_key_event(key_code, is_pressed, &times) != 0)
+      VBX_LOG("Warning: Event queue full, dropped key %d", key_code);
+  }
+}
+
+void queue_event_records(EventRecord *records, int count, void *user) {
+  (void)user;
+  uint64_t now = latency_now_us();
+  VBX_PROBE1(event_receive, now);
+  for (int i = 0; i < count; i++) {
+    EventTimes times = {records[i].time_us, now, now, now, 0};
+    VBX_PROBE4(event_parse, records[i].code, records[i].pressed,
+               times.event_us, times.parsed_us);
+    if (queue_key_event((int)records[i].code, records[i].pressed, &times) !=
+        0)
+      VBX_LOG("Warning: Event queue full, dropped key %u", records[i].code);
+  }
+}
@@ -0,0 +1,119 @@
+#include "audio/intern.h"
+#include "audio/mixer.h"
+#include "audio/playback.h"
+#include "common/utils.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  uint64_t hash; // of the source file's bytes
+  int64_t size;
+  AudioClip clip;
+} InternedClip;
+
+// Paths already seen, so a path used by many keys is only read once
+typedef struct {
+  char *path;
+  uint64_t path_hash;
+  InternedClip *clip; // NULL if the file could not be decoded
+} InternedPath;
+
+static InternedClip **clips = NULL;
+static int num_clips = 0;
+static int clips_capacity = 0;
+static InternedPath *paths = NULL;
+static int num_paths = 0;
+static int paths_capacity = 0;
+static InternStats stats = {0};
+
+static int grow(void **array, int *capacity, size_t element) {
+  int grown_capacity = *capacity ? *capacity * 2 : 64;
+  void *grown = realloc(*array, grown_capacity * element);
+  if (!grown)
+    return -1;
+  *array = grown;
+  *capacity = grown_capacity;
+  return 0;
+}
+
+static int hash_file(const char *path, uint64_t *hash, int64_t *size) {
+  static unsigned char buffer[65536];
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return -1;
+  *hash = FNV1A_OFFSET;
+  *size = 0;
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    *hash = fnv1a(*hash, buffer, n);
+    *size += (int64_t)n;
+  }
+  int rc = ferror(f) ? -1 : 0;
+  fclose(f);
+  return rc;
+}
+
+static size_t clip_bytes(const AudioClip *clip) {
+  return (size_t)clip->frames * clip->channels * sizeof(short);
+}
+
+static InternedClip *intern_contents(const char *path) {
+  uint64_t hash;
+  int64_t size;
+  if (hash_file(path, &hash, &size) != 0) {
+    fprintf(stderr, "Error: Could not read sound file: %s\n", path);
+    return NULL;
+  }
+  for (int i = 0; i < num_clips; i++) {
+    if (clips[i]->hash == hash && clips[i]->size == size) {
+      if (g_verbose)
+        printf("Sharing decoded %s with an identical file\n", path);
+      return clips[i];
+    }
+  }
+  if (num_clips == clips_capacity &&
+      grow((void **)&clips, &clips_capacity, sizeof(*clips)) != 0)
+    return NULL;
+  AudioClip *decoded = decode_clip_file(path);
+  InternedClip *c = calloc(1, sizeof(*c));
+  if (!decoded || !c) {
+    free_audio_clip(decoded);
+    free(c);
+    return NULL;
+  }
+  c->hash = hash;
+  c->size = size;
+  c->clip = *decoded;
+  free(decoded);
+  clips[num_clips++] = c;
+  stats.clips++;
+  stats.bytes += clip_bytes(&c->clip);
+  return c;
+}
+
+const AudioClip *intern_clip_file(const char *path) {
+  uint64_t path_hash = fnv1a(FNV1A_OFFSET, path, strlen(path));
+  for (int i = 0; i < num_paths; i++) {
+    if (paths[i].path_hash == path_hash && strcmp(paths[i].path, path) == 0)
+      return paths[i].clip ? &paths[i].clip->clip : NULL;
+  }
+  if (num_paths == paths_capacity &&
+      grow((void **)&paths, &paths_capacity, sizeof(*paths)) != 0)
+    return NULL;
+  char *copy = xstrdup(path);
+  if (!copy)
+    return NULL;
+  unsigned int decoded_before = stats.clips;
+  InternedClip *c = intern_contents(path);
+  paths[num_paths].path = copy;
+  paths[num_paths].path_hash = path_hash;
+  paths[num_paths++].clip = c;
+  stats.paths++;
+  if (c && stats.clips == decoded_before)
+    stats.bytes_shared += clip_bytes(&c->clip);
+  return c ? &c->clip : NULL;
+}
+
+void intern_get_stats(InternStats *out) { *out = stats; }
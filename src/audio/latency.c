@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/latency.h"
+#include "common/utils.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+// Values up to 2^28 us, about 4.5 minutes; longer ones share the last bucket
+#define MAX_MAGNITUDE 28
+#define NUM_BUCKETS ((MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) * SUB_BUCKETS)
+
+typedef struct {
+  uint64_t counts[NUM_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+} Histogram;
+
+static const char *stage_names[NUM_LATENCY_STAGES] = {
+    "input", "receive", "parse", "queue", "voice", "submit", "output",
+    "total"};
+// Written by the render thread only and read without synchronisation, like
+// the mixer counters; a dump may be an event stale
+static Histogram histograms[NUM_LATENCY_STAGES];
+static volatile long output_us = -1;
+
+uint64_t latency_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void latency_set_output_us(long us) { output_us = us; }
+
+static int bucket_of(uint64_t us) {
+  if (us < SUB_BUCKETS)
+    return (int)us;
+  // us >> shift falls in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+  int shift = 63 - __builtin_clzll(us) - SUB_BUCKET_BITS;
+  int index = (shift + 1) * SUB_BUCKETS + (int)(us >> shift) - SUB_BUCKETS;
+  return index < NUM_BUCKETS ? index : NUM_BUCKETS - 1;
+}
+
+// Highest value counted in bucket `index`
+static uint64_t bucket_high(int index) {
+  if (index < SUB_BUCKETS)
+    return (uint64_t)index;
+  int shift = index / SUB_BUCKETS - 1;
+  return ((uint64_t)(index % SUB_BUCKETS + SUB_BUCKETS + 1) << shift) - 1;
+}
+
+static void record(LatencyStage stage, uint64_t us) {
+  Histogram *h = &histograms[stage];
+  h->counts[bucket_of(us)]++;
+  h->count++;
+  h->sum += us;
+  if (us > h->max)
+    h->max = us;
+}
+
+// Skipped when a timestamp is missing or runs backwards, which means it
+// was not taken on CLOCK_MONOTONIC
+static void record_span(LatencyStage stage, uint64_t from, uint64_t to) {
+  if (from && to >= from)
+    record(stage, to - from);
+}
+
+void latency_record(const EventTimes *t, uint64_t voice_us,
+                    uint64_t submit_us) {
+  long out = output_us;
+  record_span(STAGE_INPUT, t->event_us, t->sent_us);
+  record_span(STAGE_RECEIVE, t->sent_us, t->received_us);
+  record_span(STAGE_PARSE, t->received_us, t->parsed_us);
+  record_span(STAGE_QUEUE, t->parsed_us, t->dequeued_us);
+  record_span(STAGE_VOICE, t->dequeued_us, voice_us);
+  record_span(STAGE_SUBMIT, voice_us, submit_us);
+  if (out >= 0)
+    record(STAGE_OUTPUT, (uint64_t)out);
+  if (t->event_us && submit_us >= t->event_us)
+    record(STAGE_TOTAL, submit_us - t->event_us + (out > 0 ? out : 0));
+}
+
+// Upper bound of the bucket holding the p-th percentile, capped at the
+// largest value seen
+static uint64_t percentile(const Histogram *h, double p) {
+  uint64_t rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+  if (rank < 1)
+    rank = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t high = bucket_high(i);
+      return high < h->max ? high : h->max;
+    }
+  }
+  return h->max;
+}
+
+const char *latency_stage_name(LatencyStage stage) {
+  return stage_names[stage];
+}
+
+void latency_get_summary(LatencyStage stage, LatencySummary *out) {
+  const Histogram *h = &histograms[stage];
+  out->count = h->count;
+  out->max_us = h->max;
+  if (h->count == 0) {
+    out->mean_us = 0.0;
+    out->p50_us = out->p90_us = out->p99_us = out->p999_us = 0;
+    return;
+  }
+  out->mean_us = (double)h->sum / h->count;
+  out->p50_us = percentile(h, 50.0);
+  out->p90_us = percentile(h, 90.0);
+  out->p99_us = percentile(h, 99.0);
+  out->p999_us = percentile(h, 99.9);
+}
+
+void latency_dump(FILE *f) {
+  fprintf(f, "%-8s %8s %9s %9s %9s %9s %9s %9s\n", "us", "count", "mean",
+          "p50", "p90", "p99", "p99.9", "max");
+  for (int s = 0; s < NUM_LATENCY_STAGES; s++) {
+    LatencySummary sum;
+    latency_get_summary((LatencyStage)s, &sum);
+    if (sum.count == 0) {
+      fprintf(f, "%-8s %8d\n", stage_names[s], 0);
+      continue;
+    }
+    fprintf(f, "%-8s %8llu %9.0f %9llu %9llu %9llu %9llu %9llu\n",
+            stage_names[s], (unsigned long long)sum.count, sum.mean_us,
+            (unsigned long long)sum.p50_us, (unsigned long long)sum.p90_us,
+            (unsigned long long)sum.p99_us, (unsigned long long)sum.p999_us,
+            (unsigned long long)sum.max_us);
+  }
+  for (int s = 0; s < NUM_LATENCY_STAGES; s++) {
+    const Histogram *h = &histograms[s];
+    if (h->count == 0)
+      continue;
+    fprintf(f, "\n%s\n%12s %10s %10s\n", stage_names[s], "up to us", "count",
+            "cumulative");
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+      if (h->counts[i] == 0)
+        continue;
+      seen += h->counts[i];
+      fprintf(f, "%12llu %10llu %9.3f%%\n",
+              (unsigned long long)bucket_high(i),
+              (unsigned long long)h->counts[i], 100.0 * seen / h->count);
+    }
+  }
+}
+
+int latency_dump_file(void) {
+  char path[1024], tmp_path[1100];
+  if (!safe_snprintf(path, sizeof(path), "%s/vbx-latency-%d.txt",
+                     get_runtime_dir(), (int)getuid()) ||
+      !safe_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path))
+    return -1;
+  FILE *f = fopen(tmp_path, "w");
+  if (!f)
+    return -1;
+  latency_dump(f);
+  if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
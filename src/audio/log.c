@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/log.h"
+#include "audio/latency.h"
+#include "audio/settings.h"
+#include "audio/types.h"
+#include "common/spsc.h"
+#include "common/utils.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_MAX_THREADS 8
+#define LOG_RING_SIZE 256
+// Room for a whole event line as vbx-input writes it
+#define LOG_TEXT_SIZE 240
+#define LOG_DRAIN_MS 20
+
+typedef struct {
+  uint64_t time_us;
+  int thread;
+  char text[LOG_TEXT_SIZE];
+} LogRecord;
+
+typedef struct {
+  SpscRing ring;
+  char name[16];
+  int ready;             // ring set up; published with release
+  unsigned long dropped; // written by the owning thread only
+  // Drain thread only
+  unsigned long dropped_reported;
+  LogRecord next;
+  int has_next;
+} LogThread;
+
+int g_log_enabled = 0;
+static LogThread threads[LOG_MAX_THREADS];
+static unsigned int threads_claimed = 0;
+static __thread LogThread *current = NULL;
+static __thread int unregistered = 0; // no ring could be had
+
+// Drain thread only, apart from setup and teardown
+static FILE *sink = NULL;
+static LogRecord *history = NULL;
+static int history_size = 0;
+static int history_next = 0;
+static int history_count = 0;
+
+static pthread_t drain_thread;
+static volatile int draining = 0;
+static volatile sig_atomic_t dump_requested = 0;
+static uint64_t start_us = 0;
+
+void log_register_thread(const char *name) {
+  if (current || unregistered)
+    return;
+  unsigned int slot = __atomic_fetch_add(&threads_claimed, 1, __ATOMIC_RELAXED);
+  if (slot >= LOG_MAX_THREADS) {
+    unregistered = 1;
+    return;
+  }
+  LogThread *t = &threads[slot];
+  if (spsc_init(&t->ring, sizeof(LogRecord), LOG_RING_SIZE) != 0) {
+    unregistered = 1;
+    return;
+  }
+  safe_snprintf(t->name, sizeof(t->name), "%s", name);
+  __atomic_store_n(&t->ready, 1, __ATOMIC_RELEASE);
+  current = t;
+}
+
+void log_write(const char *fmt, ...) {
+  if (!current) {
+    char name[16];
+    safe_snprintf(name, sizeof(name), "thread%u",
+                  __atomic_load_n(&threads_claimed, __ATOMIC_RELAXED));
+    log_register_thread(name);
+    if (!current)
+      return;
+  }
+  LogRecord r;
+  r.time_us = latency_now_us();
+  r.thread = (int)(current - threads);
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(r.text, sizeof(r.text), fmt, ap);
+  va_end(ap);
+  if (!spsc_push(&current->ring, &r))
+    current->dropped++;
+}
+
+void log_request_dump(void) { dump_requested = 1; }
+
+static void format_record(FILE *f, const LogRecord *r) {
+  double seconds = r->time_us >= start_us ? (r->time_us - start_us) / 1e6 : 0;
+  fprintf(f, "%12.6f %-8s %s\n", seconds, threads[r->thread].name, r->text);
+}
+
+static void keep(const LogRecord *r) {
+  if (history_size == 0)
+    return;
+  history[history_next] = *r;
+  history_next = (history_next + 1) % history_size;
+  if (history_count < history_size)
+    history_count++;
+}
+
+static void emit(const LogRecord *r) {
+  if (sink)
+    format_record(sink, r);
+  keep(r);
+}
+
+// Losses are reported in the log itself, where the gap is
+static void report_dropped(LogThread *t) {
+  unsigned long dropped = __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+  if (dropped == t->dropped_reported)
+    return;
+  LogRecord r = {.time_us = latency_now_us(), .thread = (int)(t - threads)};
+  safe_snprintf(r.text, sizeof(r.text), "[%lu records lost, ring full]",
+                dropped - t->dropped_reported);
+  t->dropped_reported = dropped;
+  emit(&r);
+}
+
+// Merge what the rings hold by time. Each ring is in order already, so
+// only their heads need comparing.
+static void drain(void) {
+  unsigned int claimed = __atomic_load_n(&threads_claimed, __ATOMIC_RELAXED);
+  int n = claimed < LOG_MAX_THREADS ? (int)claimed : LOG_MAX_THREADS;
+  int wrote = 0;
+  for (;;) {
+    LogThread *oldest = NULL;
+    for (int i = 0; i < n; i++) {
+      LogThread *t = &threads[i];
+      if (!__atomic_load_n(&t->ready, __ATOMIC_ACQUIRE))
+        continue;
+      if (!t->has_next)
+        t->has_next = spsc_pop(&t->ring, &t->next);
+      if (t->has_next && (!oldest || t->next.time_us < oldest->next.time_us))
+        oldest = t;
+    }
+    if (!oldest)
+      break;
+    emit(&oldest->next);
+    oldest->has_next = 0;
+    wrote = 1;
+  }
+  for (int i = 0; i < n; i++) {
+    if (__atomic_load_n(&threads[i].ready, __ATOMIC_ACQUIRE))
+      report_dropped(&threads[i]);
+  }
+  if (wrote && sink)
+    fflush(sink);
+}
+
+static int dump_history(void) {
+  char path[1024], tmp_path[1100];
+  if (!safe_snprintf(path, sizeof(path), "%s/vbx-log-%d.txt",
+                     get_runtime_dir(), (int)getuid()) ||
+      !safe_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path))
+    return -1;
+  FILE *f = fopen(tmp_path, "w");
+  if (!f)
+    return -1;
+  if (history_size == 0)
+    fprintf(f, "# No history kept; set audio.log.history in ~/.vbx.json\n");
+  int first = (history_next - history_count + history_size) %
+              (history_size ? history_size : 1);
+  for (int i = 0; i < history_count; i++)
+    format_record(f, &history[(first + i) % history_size]);
+  if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+static void *drain_thread_main(void *arg) {
+  (void)arg;
+  struct timespec pause = {0, LOG_DRAIN_MS * 1000000L};
+  while (draining) {
+    drain();
+    if (dump_requested) {
+      dump_requested = 0;
+      if (dump_history() != 0)
+        fprintf(stderr, "Warning: Could not write the log history\n");
+    }
+    nanosleep(&pause, NULL);
+  }
+  drain();
+  return NULL;
+}
+
+int log_start(void) {
+  const LogSettings *ls = &g_audio_settings.log;
+  if (!g_verbose && !ls->file[0] && ls->history == 0)
+    return 0;
+  start_us = latency_now_us();
+  if (ls->file[0]) {
+    sink = fopen(ls->file, "a");
+    if (!sink)
+      fprintf(stderr, "Warning: Could not open log file %s, using stderr\n",
+              ls->file);
+  }
+  if (!sink && g_verbose)
+    sink = stderr;
+  if (ls->history > 0) {
+    history = calloc((size_t)ls->history, sizeof(*history));
+    if (!history) {
+      fprintf(stderr, "Error: Memory allocation failed\n");
+      return -1;
+    }
+    history_size = ls->history;
+  }
+  draining = 1;
+  if (pthread_create(&drain_thread, NULL, drain_thread_main, NULL) != 0) {
+    fprintf(stderr, "Error: Could not start log thread\n");
+    draining = 0;
+    if (sink && sink != stderr)
+      fclose(sink);
+    sink = NULL;
+    free(history);
+    history = NULL;
+    history_size = 0;
+    return -1;
+  }
+  g_log_enabled = 1;
+  return 0;
+}
+
+// The rings stay allocated: a thread may still be inside log_write()
+void log_stop(void) {
+  if (!draining)
+    return;
+  g_log_enabled = 0;
+  draining = 0;
+  pthread_join(drain_thread, NULL);
+  if (sink && sink != stderr)
+    fclose(sink);
+  sink = NULL;
+  free(history);
+  history = NULL;
+  history_size = history_count = history_next = 0;
+}
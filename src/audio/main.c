@@ -1,19 +1,63 @@
+#include "audio/dsp.h"
+#include "audio/event_reader.h"
+#include "audio/latency.h"
+#include "audio/log.h"
+#include "audio/mixer.h"
+#include "audio/pack.h"
 #include "audio/playback.h"
+#include "audio/sample_cache.h"
+#include "audio/settings.h"
+#include "audio/stats.h"
 #include "audio/types.h"
+#include "common/input_capture.h"
+#include "common/realtime.h"
 #include "common/utils.h"
 #include <errno.h>
 #include <json-c/json.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 int g_keyboard_enabled = 1;
 int g_mouse_enabled = 1;
 
-int load_sound_config(const char *config_path);
+static volatile sig_atomic_t dump_latency = 0;
+static time_t start_time;
+// Set by the capture thread of --capture-input when it gives up
+static volatile sig_atomic_t capture_failed = 0;
+
+static void handle_sigusr2(int sig) {
+  (void)sig;
+  dump_latency = 1;
+}
+
+static void handle_sigusr1(int sig) {
+  (void)sig;
+  log_request_dump();
+}
+
+// At most once a second: the output latency is asked here so the render
+// thread never has to, and the counters are published for `vbx --stats`
+static void update_stats(void) {
+  static uint64_t last_us = 0;
+  static int warned = 0;
+  uint64_t now = latency_now_us();
+  if (last_us && now - last_us < 1000000)
+    return;
+  last_us = now;
+  latency_set_output_us(mixer_output_latency_us());
+  if (write_engine_stats(start_time) != 0 && !warned) {
+    warned = 1;
+    fprintf(stderr, "Warning: Could not write the engine stats file\n");
+  }
+}
 
 // Generic function to read runtime state files
 static int read_runtime_state(const char *filename_suffix, int default_value) {
@@ -59,13 +103,98 @@ static int read_mouse_enabled_state() {
   return read_runtime_state("mouse-enabled", 1);
 }
 
+// The render and playback threads set themselves up; this covers the stdin
+// reader and locks the decoded packs, the voice pool and the rings, all of
+// which are allocated by now. Sounds a lazy pack decodes later are not
+// locked, so a full lock never makes a later allocation fail.
+static void setup_realtime(void) {
+  const RealtimeSettings *rs = &g_audio_settings.realtime;
+  // Below the playback thread, which is below the render thread
+  int priority = rs->priority > 2 ? rs->priority - 2 : 1;
+  if (realtime_setup_thread("reader", priority, -1) == 0 && g_verbose)
+    printf("Reader thread: SCHED_FIFO priority %d\n", priority);
+  if (!rs->lock_memory)
+    return;
+  if (mlockall(MCL_CURRENT) != 0) {
+    safe_fprintf(stderr,
+                 "Warning: Could not lock memory (%s); raise the memlock "
+                 "limit (ulimit -l) to keep sounds from being paged out\n",
+                 strerror(errno));
+    return;
+  }
+  if (g_verbose)
+    printf("Memory locked\n");
+}
+
+// --capture-input: events come from libinput on a thread of this process
+// instead of down the pipe from vbx-input, and go to queue_event_records()
+static void *capture_thread(void *arg) {
+  InputCapture *capture = arg;
+  const RealtimeSettings *rs = &g_audio_settings.realtime;
+  log_register_thread("input");
+  if (rs->enabled)
+    realtime_setup_thread("input", rs->priority, rs->input_cpu);
+  else if (rs->input_cpu >= 0 && realtime_pin_thread(rs->input_cpu) != 0)
+    safe_fprintf(stderr, "Warning: Could not pin the input thread to CPU %d\n",
+                 rs->input_cpu);
+  if (input_capture_run(capture, queue_event_records, NULL) != 0)
+    capture_failed = 1;
+  return NULL;
+}
+
+// vbx-audio --build-pack <config.json> <out.vbxpack> [verbose], run by
+// `vbx pack build` and `make install PACKS=1`
+static int build_pack(int argc, char *argv[]) {
+  if (argc < 4 || argc > 5) {
+    safe_fprintf(stderr,
+                 "Usage: %s --build-pack <config.json> <out.vbxpack> "
+                 "[verbose]\n",
+                 argv[0]);
+    return 1;
+  }
+  if (argc == 5)
+    g_verbose = atoi(argv[4]);
+  load_audio_settings();
+  // A bundle holds every sound, however big the pack
+  g_audio_settings.sample_cache_mb = 0;
+  SoundPack *pack = sound_pack_new();
+  if (!pack || load_sound_config(pack, argv[2]) != 0 ||
+      decode_sound_pack(pack) != 0) {
+    safe_fprintf(stderr, "Failed to load sound pack %s\n", argv[2]);
+    sound_pack_free(pack);
+    return 1;
+  }
+  int rc = write_pack_file(pack, argv[2], argv[3]);
+  sound_pack_free(pack);
+  if (rc != 0) {
+    safe_fprintf(stderr, "Failed to build %s\n", argv[3]);
+    return 1;
+  }
+  printf("Built %s\n", argv[3]);
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
+  start_time = time(NULL);
+  // Before any pack is decoded, so load-time resampling gets the fast kernels
+  dsp_init();
+  if (argc >= 2 && strcmp(argv[1], "--build-pack") == 0)
+    return build_pack(argc, argv);
+  // Positional arguments keep their places after it
+  int capture = argc >= 2 && strcmp(argv[1], "--capture-input") == 0;
+  if (capture) {
+    argv[1] = argv[0];
+    argv++;
+    argc--;
+  }
   if (argc < 2 || argc > 11) {
     safe_fprintf(stderr,
-            "Usage: %s <config.json> [volume] [verbose] [mute] [mouse_config] "
-            "[mouse_volume] [keyboard_mute] [mouse_mute] [keyboard_enabled] "
-            "[mouse_enabled]\n",
+            "Usage: %s [--capture-input] <config.json> [volume] [verbose] "
+            "[mute] [mouse_config] [mouse_volume] [keyboard_mute] "
+            "[mouse_mute] [keyboard_enabled] [mouse_enabled]\n",
             argv[0]);
+    safe_fprintf(stderr, "  --capture-input: read keys and buttons with "
+                         "libinput instead of from stdin\n");
     safe_fprintf(stderr, "  volume: 0-100 (default: 50)\n");
     safe_fprintf(stderr, "  verbose: 1 to enable verbose output (default: 0)\n");
     safe_fprintf(stderr, "  mute: 1 to mute all sound (default: 0)\n");
@@ -99,12 +228,21 @@ int main(int argc, char *argv[]) {
       printf("Sound muted\n");
     }
   }
+  load_audio_settings();
+  if (log_start() != 0)
+    fprintf(stderr, "Warning: Continuing without the diagnostic log\n");
+  // Only the drain thread services dumps; without it SIGUSR1 keeps its
+  // default action
+  if (g_log_enabled)
+    signal(SIGUSR1, handle_sigusr1);
+  log_register_thread("reader");
+  SoundPack *mouse_pack = NULL, *keyboard_pack;
   if (argc >= 6) {
-    if (load_sound_config(argv[5]) != 0) {
+    mouse_pack = load_sound_pack(argv[5]);
+    if (!mouse_pack) {
       safe_fprintf(stderr, "Failed to load mouse sound configuration\n");
       return 1;
     }
-    g_mouse_sound_pack = g_sound_pack;
     if (g_verbose) {
       printf("Mouse sound pack loaded from: %s\n", argv[5]);
     }
@@ -135,17 +273,62 @@ int main(int argc, char *argv[]) {
     if (g_verbose)
       printf("Mouse enabled: %s\n", g_mouse_enabled ? "yes" : "no");
   }
-  if (load_sound_config(argv[1]) != 0) {
+  if (g_verbose)
+    printf("Polyphony: %d voices, stealing %s\n", g_audio_settings.polyphony,
+           g_audio_settings.steal_policy == STEAL_QUIETEST ? "quietest"
+                                                           : "oldest");
+  keyboard_pack = load_sound_pack(argv[1]);
+  if (!keyboard_pack) {
     safe_fprintf(stderr, "Failed to load keyboard sound configuration\n");
+    sound_pack_free(mouse_pack);
+    return 1;
+  }
+  if (mixer_init() != 0) {
+    safe_fprintf(stderr, "Failed to open audio output stream\n");
+    sound_pack_free(keyboard_pack);
+    sound_pack_free(mouse_pack);
     return 1;
   }
-  if (init_audio() != 0) {
-    safe_fprintf(stderr, "Failed to initialize audio\n");
+  if (g_verbose) {
+    printf("Mixer kernels: %s\n", g_dsp.name);
+    printf("Output backend: %s, latency %ld us\n", mixer_backend_name(),
+           mixer_output_latency_us());
+  }
+  InputCapture *input = NULL;
+  if (capture) {
+    input = input_capture_open();
+    if (!input) {
+      mixer_shutdown();
+      sound_pack_free(keyboard_pack);
+      sound_pack_free(mouse_pack);
+      return 1;
+    }
+  }
+  if (start_playback_thread(keyboard_pack, mouse_pack) != 0) {
+    input_capture_close(input);
+    mixer_shutdown();
+    sound_pack_free(keyboard_pack);
+    sound_pack_free(mouse_pack);
     return 1;
   }
+  if (g_audio_settings.realtime.enabled)
+    setup_realtime();
+  // Started after setup_realtime(), whose mlockall() covers its stack too
+  pthread_t capture_tid;
+  int capture_running = 0;
+  if (input && pthread_create(&capture_tid, NULL, capture_thread, input) != 0) {
+    safe_fprintf(stderr, "Failed to create input capture thread\n");
+    capture_failed = 1;
+  } else if (input) {
+    capture_running = 1;
+    if (g_verbose)
+      printf("Capturing input in-process\n");
+  }
+  signal(SIGUSR2, handle_sigusr2);
   fd_set readfds;
   struct timeval timeout;
-  char line[1024];
+  static EventReader reader;
+  event_reader_init(&reader);
   while (1) {
     g_mute = read_mute_state();
     g_keyboard_mute = read_keyboard_mute_state();
@@ -153,12 +336,24 @@ int main(int argc, char *argv[]) {
 
     g_keyboard_enabled = read_keyboard_enabled_state();
     g_mouse_enabled = read_mouse_enabled_state();
+    update_stats();
+    if (dump_latency) {
+      dump_latency = 0;
+      if (latency_dump_file() != 0)
+        fprintf(stderr, "Warning: Could not write the latency histograms\n");
+    }
+
+    if (capture_failed)
+      break;
 
     FD_ZERO(&readfds);
-    FD_SET(STDIN_FILENO, &readfds);
+    // With --capture-input this only sleeps between the polls above
+    if (!capture)
+      FD_SET(STDIN_FILENO, &readfds);
     timeout.tv_sec = 1;
     timeout.tv_usec = 0;
-    int ready = select(STDIN_FILENO + 1, &readfds, NULL, NULL, &timeout);
+    int ready = select(capture ? 0 : STDIN_FILENO + 1, &readfds, NULL, NULL,
+                       &timeout);
     if (ready == -1) {
       if (errno == EINTR) {
         continue;
@@ -166,26 +361,69 @@ int main(int argc, char *argv[]) {
       perror("select");
       break;
     } else if (ready == 0) {
-      if (g_verbose) {
+      if (g_verbose && !capture) {
         printf("Waiting for input...\n");
       }
       continue;
     }
     if (FD_ISSET(STDIN_FILENO, &readfds)) {
-      if (fgets(line, sizeof(line), stdin) == NULL) {
-        if (feof(stdin)) {
-          if (g_verbose)
-            printf("EOF reached on stdin\n");
-        } else {
-          perror("fgets");
-        }
+      ssize_t n = event_reader_fill(&reader, STDIN_FILENO);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0) {
+        perror("read");
         break;
       }
-      int key_code, is_pressed;
-      if (parse_keyboard_event(line, &key_code, &is_pressed) == 0) {
-        play_sound_segment(key_code, is_pressed);
+      if (n == 0)
+        event_reader_finish(&reader);
+      event_reader_queue(&reader);
+      if (n == 0) {
+        if (g_verbose)
+          printf("EOF reached on stdin\n");
+        break;
       }
     }
   }
+  // The capture thread queues events until it is joined, so it goes first
+  if (capture_running) {
+    input_capture_stop(input);
+    pthread_join(capture_tid, NULL);
+  }
+  input_capture_close(input);
+  stop_playback_thread();
+  mixer_shutdown();
+  remove_engine_stats();
+  log_stop();
+  if (g_verbose) {
+    SampleCacheStats cache;
+    sample_cache_get_stats(&cache);
+    if (cache.hits + cache.misses > 0)
+      printf("Sample cache: %lu hits, %lu misses, %lu evictions, "
+             "%.1f/%.0f MiB in %u files\n",
+             cache.hits, cache.misses, cache.evictions,
+             cache.bytes / 1048576.0, cache.budget / 1048576.0,
+             cache.entries);
+  }
+  sample_cache_clear();
+  // The mixer may have played clips out of the packs until its shutdown
+  sound_pack_free(keyboard_pack);
+  sound_pack_free(mouse_pack);
+  if (g_verbose) {
+    MixerStats stats;
+    EventQueueStats queue;
+    mixer_get_stats(&stats);
+    get_event_queue_stats(&queue);
+    printf("Voices: %lu started, %lu stolen, %lu retriggered, %lu dropped, "
+           "peak %lu/%d\n",
+           stats.voices_started, stats.voices_stolen,
+           stats.voices_retriggered, stats.events_dropped, stats.peak_voices,
+           g_audio_settings.polyphony);
+    printf("Event queue: high-water %u/%u, %lu dropped; voice queue "
+           "high-water %u\n",
+           queue.high_water, queue.capacity, queue.dropped,
+           stats.command_high_water);
+    printf("Output underruns: %lu\n", stats.underruns);
+    latency_dump(stdout);
+  }
   return 0;
 }
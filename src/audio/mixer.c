@@ -0,0 +1,460 @@
+#include "audio/mixer.h"
+#include "audio/backend.h"
+#include "audio/dsp.h"
+#include "audio/settings.h"
+#include "audio/types.h"
+#include "common/realtime.h"
+#include "common/spsc.h"
+#include "common/trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every playing voice can leave one fading tail behind when it is stolen,
+// so the preallocated pool is twice the polyphony ceiling.
+#define VOICE_POOL_SIZE (MAX_POLYPHONY * 2)
+// 2 ms at the engine rate, short enough not to smear but long enough to
+// avoid a click when a voice is cut
+#define VOICE_FADE_FRAMES 96
+#define COMMAND_RING_SIZE 256
+// Between two mixer_reclaim() calls at most a full command ring and every
+// voice can retire a clip, so the retire ring never fills
+#define RETIRE_RING_SIZE 512
+
+typedef enum { VOICE_FREE, VOICE_PLAYING, VOICE_FADING } VoiceState;
+
+typedef struct {
+  AudioClip *clip;
+  double position;
+  double step;
+  float gain;
+  float level;          // peak output sample of the last mixed period
+  unsigned long serial; // start order, for stealing the oldest voice
+  int priority;
+  int group;
+  int is_release;
+  int fade_frames; // length of the fade-out in progress
+  int fade_remaining;
+  int owns_clip;
+  VoiceState state;
+} Voice;
+
+// A voice start request from mixer_play() to the render thread
+typedef struct {
+  AudioClip *clip;
+  float gain;
+  int owns_clip;
+  int priority;
+  int group;
+  int is_release;
+  EventTimes times;
+} VoiceCommand;
+
+// The voice pool is only touched by the thread that renders. New voices
+// arrive through command_ring and clips the mixer owned go back through
+// retire_ring, so neither side ever waits for the other.
+static Voice voices[VOICE_POOL_SIZE];
+static unsigned long next_serial = 0;
+static MixerStats stats = {0};
+static SpscRing command_ring;
+static SpscRing retire_ring;
+static unsigned long commands_dropped = 0;
+static int mixer_running = 0;
+static const AudioBackend *backend = NULL;
+static pthread_t push_thread;
+static volatile int push_running = 0;
+
+void free_audio_clip(AudioClip *clip) {
+  if (!clip)
+    return;
+  if (clip->release) {
+    clip->release(clip);
+    return;
+  }
+  free(clip->pcm);
+  free(clip);
+}
+
+// Add one voice into the stereo float accumulator. Clips already at the
+// engine rate go through the vector kernels; others are resampled linearly
+// here, as is the fade-out of a stolen voice. Returns 0 once the voice has
+// ended, either at the end of the clip or at the end of its fade-out.
+static int mix_voice(Voice *v, float *accum, int frames) {
+  const AudioClip *c = v->clip;
+  if (v->state == VOICE_PLAYING && c->samplerate == ENGINE_SAMPLE_RATE &&
+      c->channels <= ENGINE_CHANNELS) {
+    long position = (long)v->position;
+    long remaining = c->frames - position;
+    int n = remaining < frames ? (int)remaining : frames;
+    int peak = c->channels == 1
+                   ? g_dsp.accumulate_mono(accum, c->pcm + position, n,
+                                           v->gain)
+                   : g_dsp.accumulate(accum, c->pcm + position * c->channels,
+                                      n * c->channels, v->gain);
+    v->level = peak * v->gain;
+    v->position += n;
+    return n < remaining;
+  }
+  float peak = 0.0f;
+  for (int i = 0; i < frames; i++) {
+    long idx = (long)v->position;
+    if (idx >= c->frames)
+      return 0;
+    float gain = v->gain;
+    if (v->state == VOICE_FADING) {
+      if (v->fade_remaining <= 0)
+        return 0;
+      gain *= (float)v->fade_remaining-- / v->fade_frames;
+    }
+    float frac = (float)(v->position - (double)idx);
+    const short *s0 = c->pcm + idx * c->channels;
+    const short *s1 = idx + 1 < c->frames ? s0 + c->channels : s0;
+    float left = (s0[0] + (s1[0] - s0[0]) * frac) * gain;
+    float right =
+        c->channels > 1 ? (s0[1] + (s1[1] - s0[1]) * frac) * gain : left;
+    accum[i * ENGINE_CHANNELS] += left;
+    accum[i * ENGINE_CHANNELS + 1] += right;
+    float magnitude = left < 0 ? -left : left;
+    if (magnitude > peak)
+      peak = magnitude;
+    magnitude = right < 0 ? -right : right;
+    if (magnitude > peak)
+      peak = magnitude;
+    v->position += v->step;
+  }
+  v->level = peak;
+  return (long)v->position < c->frames;
+}
+
+// Hand a clip back to the control thread for freeing. free() may lock and
+// cache-lent clips must be released on the mixer_play() thread, so the
+// render thread only frees itself if the ring is somehow full.
+static void retire_clip(AudioClip *clip) {
+  if (clip && !spsc_push(&retire_ring, &clip))
+    free_audio_clip(clip);
+}
+
+static int start_voice(const VoiceCommand *cmd);
+static Voice *retrigger_group(const VoiceCommand *cmd);
+
+static void end_voice(Voice *v) {
+  VBX_PROBE3(voice_end, (int)(v - voices), v->group, latency_now_us());
+  if (v->owns_clip)
+    retire_clip(v->clip);
+}
+
+static void render_period(short *out, int frames) {
+  float accum[MIXER_PERIOD_FRAMES * ENGINE_CHANNELS];
+  // Events whose voices start in this period, timed once it is submitted
+  EventTimes started[COMMAND_RING_SIZE];
+  int num_started = 0;
+  uint64_t voice_us = 0;
+  VoiceCommand cmd;
+  while (spsc_pop(&command_ring, &cmd)) {
+    // A release without a clip of its own only fades its key's voices
+    if (!cmd.clip) {
+      retrigger_group(&cmd);
+      continue;
+    }
+    if (!voice_us)
+      voice_us = latency_now_us();
+    if (start_voice(&cmd) && cmd.times.parsed_us &&
+        num_started < COMMAND_RING_SIZE)
+      started[num_started++] = cmd.times;
+  }
+  memset(accum, 0, frames * ENGINE_CHANNELS * sizeof(float));
+  unsigned int active = 0;
+  for (int i = 0; i < VOICE_POOL_SIZE; i++) {
+    Voice *v = &voices[i];
+    if (v->state == VOICE_FREE)
+      continue;
+    active++;
+    if (!mix_voice(v, accum, frames)) {
+      end_voice(v);
+      v->clip = NULL;
+      v->state = VOICE_FREE;
+    }
+  }
+  stats.active_voices = active;
+  g_dsp.to_s16(out, accum, frames * ENGINE_CHANNELS);
+  // The clock is only read for periods that started a voice
+  uint64_t submit_us = num_started > 0 ? latency_now_us() : 0;
+  VBX_PROBE4(buffer_submit, frames, active, num_started, submit_us);
+  for (int i = 0; i < num_started; i++)
+    latency_record(&started[i], voice_us, submit_us);
+}
+
+void mixer_setup_render_thread(void) {
+  const RealtimeSettings *rs = &g_audio_settings.realtime;
+  if (!rs->enabled)
+    return;
+  if (realtime_setup_thread("mixer", rs->priority, rs->mixer_cpu) == 0 &&
+      g_verbose)
+    printf("Mixer thread: SCHED_FIFO priority %d%s\n", rs->priority,
+           rs->mixer_cpu >= 0 ? ", pinned" : "");
+}
+
+// Called by the output backend whenever it wants more audio. Silence is
+// rendered too, so the stream never underruns and a new voice is heard
+// within one request instead of after a fresh prebuffer.
+void mixer_render(short *out, int frames) {
+  while (frames > 0) {
+    int n = frames < MIXER_PERIOD_FRAMES ? frames : MIXER_PERIOD_FRAMES;
+    render_period(out, n);
+    out += n * ENGINE_CHANNELS;
+    frames -= n;
+  }
+}
+
+// Drives push backends, whose write() blocks for one period's worth of time
+static void *push_thread_main(void *arg) {
+  (void)arg;
+  short out[MIXER_PERIOD_FRAMES * ENGINE_CHANNELS];
+  mixer_setup_render_thread();
+  while (push_running) {
+    render_period(out, MIXER_PERIOD_FRAMES);
+    if (backend->write(out, MIXER_PERIOD_FRAMES) != 0)
+      break;
+  }
+  return NULL;
+}
+
+int mixer_init(void) {
+  if (spsc_init(&command_ring, sizeof(VoiceCommand), COMMAND_RING_SIZE) != 0 ||
+      spsc_init(&retire_ring, sizeof(AudioClip *), RETIRE_RING_SIZE) != 0) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return -1;
+  }
+  backend = find_audio_backend(g_audio_settings.backend);
+  if (!backend) {
+    fprintf(stderr, "Unknown audio backend '%s'\n", g_audio_settings.backend);
+    print_audio_backends();
+    return -1;
+  }
+  if (backend->open(&g_audio_settings, mixer_render) != 0)
+    return -1;
+  if (backend->write) {
+    push_running = 1;
+    if (pthread_create(&push_thread, NULL, push_thread_main, NULL) != 0) {
+      fprintf(stderr, "Could not start mixer thread\n");
+      push_running = 0;
+      backend->close();
+      return -1;
+    }
+  }
+  mixer_running = 1;
+  return 0;
+}
+
+const char *mixer_backend_name(void) { return backend ? backend->name : ""; }
+
+// Pick the playing voice to give up for a new voice of `priority`. Only
+// voices of equal or lower priority are candidates, and the lowest priority
+// class present is always chosen first, so keyboard voices are never stolen
+// for mouse clicks.
+static Voice *choose_victim(int priority) {
+  Voice *victim = NULL;
+  for (int i = 0; i < VOICE_POOL_SIZE; i++) {
+    Voice *v = &voices[i];
+    if (v->state != VOICE_PLAYING || v->priority > priority)
+      continue;
+    if (!victim || v->priority < victim->priority) {
+      victim = v;
+      continue;
+    }
+    if (v->priority != victim->priority)
+      continue;
+    if (g_audio_settings.steal_policy == STEAL_QUIETEST
+            ? v->level < victim->level
+            : v->serial < victim->serial)
+      victim = v;
+  }
+  return victim;
+}
+
+static void fade_voice(Voice *v, int frames) {
+  v->state = VOICE_FADING;
+  v->fade_frames = frames > 0 ? frames : 1;
+  v->fade_remaining = v->fade_frames;
+}
+
+static int ms_to_frames(double ms) {
+  return (int)(ms * ENGINE_SAMPLE_RATE / 1000.0);
+}
+
+// Fade out the voices of the command's key that it replaces: everything
+// still playing on a press, the press voices on a release if the settings
+// ask for it. Returns one of them for reuse if the pool runs out.
+static Voice *retrigger_group(const VoiceCommand *cmd) {
+  const AudioSettings *s = &g_audio_settings;
+  int frames;
+  if (cmd->group == VOICE_NO_GROUP)
+    return NULL;
+  if (cmd->is_release) {
+    if (s->release_fade_ms <= 0.0)
+      return NULL;
+    frames = ms_to_frames(s->release_fade_ms);
+  } else if (s->retrigger == RETRIGGER_STACK) {
+    return NULL;
+  } else {
+    // The new voice starts at full level either way: fading it in would
+    // soften the attack the click is made of
+    frames = s->retrigger == RETRIGGER_CUT
+                 ? VOICE_FADE_FRAMES
+                 : ms_to_frames(s->retrigger_fade_ms);
+  }
+  Voice *replaced = NULL;
+  for (int i = 0; i < VOICE_POOL_SIZE; i++) {
+    Voice *v = &voices[i];
+    if (v->state != VOICE_PLAYING || v->group != cmd->group ||
+        (cmd->is_release && v->is_release))
+      continue;
+    fade_voice(v, frames);
+    stats.voices_retriggered++;
+    replaced = v;
+  }
+  return replaced;
+}
+
+// Runs on the render thread at the start of a period. Returns 0 if the
+// event was dropped.
+static int start_voice(const VoiceCommand *cmd) {
+  Voice *replaced = retrigger_group(cmd);
+  Voice *slot = NULL;
+  int playing = 0;
+  for (int i = 0; i < VOICE_POOL_SIZE; i++) {
+    if (voices[i].state == VOICE_PLAYING)
+      playing++;
+    else if (voices[i].state == VOICE_FREE && !slot)
+      slot = &voices[i];
+  }
+  if (playing >= g_audio_settings.polyphony) {
+    Voice *victim = choose_victim(cmd->priority);
+    if (!victim) {
+      stats.events_dropped++;
+      if (cmd->owns_clip)
+        retire_clip(cmd->clip);
+      return 0;
+    }
+    stats.voices_stolen++;
+    if (slot) {
+      fade_voice(victim, VOICE_FADE_FRAMES);
+    } else {
+      // Pool exhausted by fading tails: reuse the victim without a fade
+      end_voice(victim);
+      slot = victim;
+    }
+  }
+  if (!slot && replaced) {
+    // Pool exhausted: the replaced voice ends without its fade
+    end_voice(replaced);
+    slot = replaced;
+  }
+  if (!slot) {
+    stats.events_dropped++;
+    if (cmd->owns_clip)
+      retire_clip(cmd->clip);
+    return 0;
+  }
+  const AudioClip *clip = cmd->clip;
+  slot->clip = cmd->clip;
+  slot->position = 0.0;
+  slot->step = (double)clip->samplerate / ENGINE_SAMPLE_RATE;
+  slot->gain = cmd->gain;
+  slot->level = cmd->gain * 32767.0f;
+  slot->serial = next_serial++;
+  slot->priority = cmd->priority;
+  slot->group = cmd->group;
+  slot->is_release = cmd->is_release;
+  slot->owns_clip = cmd->owns_clip;
+  slot->state = VOICE_PLAYING;
+  VBX_PROBE3(voice_start, (int)(slot - voices), cmd->group,
+             cmd->times.event_us);
+  stats.voices_started++;
+  if (playing < g_audio_settings.polyphony)
+    playing++;
+  if ((unsigned long)playing > stats.peak_voices)
+    stats.peak_voices = (unsigned long)playing;
+  return 1;
+}
+
+int mixer_play(AudioClip *clip, float gain, int take_ownership, int priority,
+               int group, int is_release, const EventTimes *times) {
+  if (!clip || clip->frames <= 0 || clip->channels <= 0 ||
+      clip->samplerate <= 0)
+    return -1;
+  mixer_reclaim();
+  VoiceCommand cmd = {.clip = clip,
+                      .gain = gain,
+                      .owns_clip = take_ownership,
+                      .priority = priority,
+                      .group = group,
+                      .is_release = is_release};
+  if (times)
+    cmd.times = *times;
+  if (!spsc_push(&command_ring, &cmd)) {
+    commands_dropped++;
+    return -1;
+  }
+  return 0;
+}
+
+int mixer_release(int group) {
+  if (g_audio_settings.release_fade_ms <= 0.0)
+    return 0;
+  mixer_reclaim();
+  VoiceCommand cmd = {.group = group, .is_release = 1};
+  if (!spsc_push(&command_ring, &cmd)) {
+    commands_dropped++;
+    return -1;
+  }
+  return 0;
+}
+
+void mixer_reclaim(void) {
+  AudioClip *clip;
+  while (spsc_pop(&retire_ring, &clip))
+    free_audio_clip(clip);
+}
+
+// Counters are written by the render thread only and read here without
+// synchronisation; a snapshot may be a period stale
+void mixer_get_stats(MixerStats *out) {
+  *out = stats;
+  out->events_dropped += commands_dropped;
+  out->command_high_water = spsc_high_water(&command_ring);
+  out->underruns = backend ? backend->underruns() : 0;
+}
+
+long mixer_output_latency_us(void) {
+  return backend ? backend->latency_us() : -1;
+}
+
+void mixer_shutdown(void) {
+  if (!mixer_running)
+    return;
+  mixer_running = 0;
+  if (push_running) {
+    push_running = 0;
+    pthread_join(push_thread, NULL);
+  }
+  backend->close();
+  // The render thread is gone, so pending commands and voices are ours
+  VoiceCommand cmd;
+  while (spsc_pop(&command_ring, &cmd)) {
+    if (cmd.owns_clip)
+      free_audio_clip(cmd.clip);
+  }
+  for (int i = 0; i < VOICE_POOL_SIZE; i++) {
+    if (voices[i].state != VOICE_FREE) {
+      if (voices[i].owns_clip)
+        free_audio_clip(voices[i].clip);
+      voices[i].clip = NULL;
+      voices[i].state = VOICE_FREE;
+    }
+  }
+  mixer_reclaim();
+  spsc_free(&command_ring);
+  spsc_free(&retire_ring);
+}
@@ -0,0 +1,485 @@
+#define _XOPEN_SOURCE 700
+#include "audio/pack.h"
+#include "audio/latency.h"
+#include "audio/playback.h"
+#include "audio/settings.h"
+#include "audio/soundpack.h"
+#include "common/trace.h"
+#include "common/utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PCM_ALIGN 64
+
+static PackLoadStats load_stats = {0};
+
+// Anything that changes the decoded PCM must be folded in here; the format
+// version covers the pitch variant steps
+static uint64_t pack_params(void) {
+  const TrimSettings *ts = &g_audio_settings.trim;
+  // Hundredths of a dB and of a ms
+  int32_t params[] = {PACK_FORMAT_VERSION,
+                      ENGINE_SAMPLE_RATE,
+                      ENGINE_CHANNELS,
+                      ts->enabled,
+                      ts->enabled ? (int32_t)(ts->threshold_db * 100.0) : 0,
+                      ts->enabled ? (int32_t)(ts->fade_ms * 100.0) : 0};
+  return fnv1a(FNV1A_OFFSET, params, sizeof(params));
+}
+
+static void config_dir_of(const char *config_path, char *out, size_t size) {
+  char copy[1024];
+  safe_strncpy(copy, config_path, sizeof(copy));
+  safe_strncpy(out, dirname(copy), size);
+}
+
+static double elapsed_ms(const struct timespec *start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e3 +
+         (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Index of the clip of `sound` in the unique clip table, adding it if it is
+// new
+static int32_t clip_index(const SoundPack *pack, int sound,
+                          const AudioClip **unique, int *count) {
+  const AudioClip *clip = &pack->sounds[sound].clip;
+  if (!clip->pcm || clip->frames <= 0)
+    return NO_SOUND;
+  for (int i = 0; i < *count; i++) {
+    if (unique[i]->pcm == clip->pcm && unique[i]->frames == clip->frames &&
+        unique[i]->channels == clip->channels)
+      return i;
+  }
+  unique[*count] = clip;
+  return (*count)++;
+}
+
+static int add_source(PackSource *sources, int *count, int capacity,
+                      const char *path, const char *config_dir) {
+  if (!path || !path[0])
+    return 0;
+  const char *name = path;
+  size_t dir_len = strlen(config_dir);
+  if (strncmp(path, config_dir, dir_len) == 0 && path[dir_len] == '/')
+    name = path + dir_len + 1;
+  for (int i = 0; i < *count; i++) {
+    if (strcmp(sources[i].path, name) == 0)
+      return 0;
+  }
+  struct stat st;
+  if (*count >= capacity || stat(path, &st) != 0 ||
+      strlen(name) >= sizeof(sources[0].path))
+    return -1;
+  PackSource *s = &sources[(*count)++];
+  memset(s, 0, sizeof(*s));
+  s->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  s->size = (int64_t)st.st_size;
+  safe_strncpy(s->path, name, sizeof(s->path));
+  return 0;
+}
+
+// Room for config.json, the sound file and every sound's file
+static int max_sources(const SoundPack *pack) { return pack->num_sounds + 2; }
+
+static int collect_sources(const SoundPack *pack, const char *config_path,
+                           const char *config_dir, PackSource *sources) {
+  int count = 0, capacity = max_sources(pack);
+  int rc = add_source(sources, &count, capacity, config_path, config_dir);
+  if (!pack->is_multi) {
+    rc |= add_source(sources, &count, capacity,
+                     sound_pack_string(pack, pack->sound_file), config_dir);
+    return rc ? -1 : count;
+  }
+  for (int i = 0; i < pack->num_sounds; i++)
+    rc |= add_source(sources, &count, capacity, sound_pack_path(pack, i),
+                     config_dir);
+  return rc ? -1 : count;
+}
+
+int write_pack_file(const SoundPack *pack, const char *config_path,
+                    const char *out_path) {
+  char config_dir[1024];
+  config_dir_of(config_path, config_dir, sizeof(config_dir));
+  PackHeader *header = calloc(1, sizeof(*header));
+  const AudioClip **unique = calloc(pack->num_sounds + 1, sizeof(*unique));
+  PackClip *clips = calloc(pack->num_sounds + 1, sizeof(*clips));
+  PackBankEntry *banks = calloc(pack->num_banks + 1, sizeof(*banks));
+  int32_t *variants = calloc(pack->num_variants + 1, sizeof(*variants));
+  PackSource *sources = calloc(max_sources(pack), sizeof(*sources));
+  char tmp_path[1100];
+  FILE *f = NULL;
+  int rc = -1;
+  if (!header || !unique || !clips || !banks || !variants || !sources)
+    goto out;
+  int num_sources = collect_sources(pack, config_path, config_dir, sources);
+  if (num_sources < 0) {
+    fprintf(stderr, "Warning: Could not stat the files of %s\n", config_path);
+    goto out;
+  }
+  int num_clips = 0;
+  memcpy(header->magic, PACK_MAGIC, 4);
+  header->version = PACK_FORMAT_VERSION;
+  header->header_size = sizeof(*header);
+  header->flags = pack->is_multi ? PACK_FLAG_MULTI : 0;
+  header->params = pack_params();
+  // Bank indices carry over as is; variants are renumbered by clip
+  uint32_t num_variants = 0;
+  for (int b = 0; b < pack->num_banks; b++) {
+    const PackBank *bank = &pack->banks[b];
+    banks[b].first = num_variants;
+    for (int i = 0; i < bank->count; i++) {
+      int32_t clip = clip_index(pack, pack->variants[bank->first + i], unique,
+                                &num_clips);
+      if (clip != NO_SOUND)
+        variants[num_variants++] = clip;
+    }
+    banks[b].count = num_variants - banks[b].first;
+  }
+  for (int key = 0; key < PACK_KEYS; key++) {
+    header->key_press[key] = PACK_NO_BANK;
+    header->key_release[key] = PACK_NO_BANK;
+  }
+  for (int i = 0; i < pack->num_keys; i++) {
+    const PackKey *k = &pack->keys[i];
+    header->key_press[k->code] = k->press;
+    header->key_release[k->code] = k->release;
+  }
+  header->generic_press = pack->generic_press;
+  header->release = pack->release;
+  uint64_t samples = 0;
+  for (int i = 0; i < num_clips; i++) {
+    clips[i].offset = samples;
+    clips[i].frames = (uint32_t)unique[i]->frames;
+    clips[i].channels = (uint16_t)unique[i]->channels;
+    samples += (uint64_t)unique[i]->frames * unique[i]->channels;
+  }
+  header->num_clips = (uint32_t)num_clips;
+  header->num_sources = (uint32_t)num_sources;
+  header->num_banks = (uint32_t)pack->num_banks;
+  header->num_variants = num_variants;
+  header->clips_offset = sizeof(*header);
+  header->banks_offset =
+      header->clips_offset + (uint64_t)num_clips * sizeof(PackClip);
+  header->sources_offset = header->banks_offset +
+                           (uint64_t)pack->num_banks * sizeof(PackBankEntry);
+  // Last before the padding, so the 8-byte fields above stay aligned
+  header->variants_offset =
+      header->sources_offset + (uint64_t)num_sources * sizeof(PackSource);
+  uint64_t end =
+      header->variants_offset + (uint64_t)num_variants * sizeof(int32_t);
+  header->pcm_offset = (end + PCM_ALIGN - 1) / PCM_ALIGN * PCM_ALIGN;
+  header->pcm_bytes = samples * sizeof(short);
+
+  // Write beside the target and rename, so readers never map a partial file
+  if (!safe_snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", out_path,
+                     (int)getpid()))
+    goto out;
+  f = fopen(tmp_path, "wb");
+  if (!f) {
+    fprintf(stderr, "Warning: Could not write %s: %s\n", tmp_path,
+            strerror(errno));
+    goto out;
+  }
+  static const char padding[PCM_ALIGN] = {0};
+  int ok = fwrite(header, sizeof(*header), 1, f) == 1 &&
+           fwrite(clips, sizeof(PackClip), num_clips, f) ==
+               (size_t)num_clips &&
+           fwrite(banks, sizeof(PackBankEntry), pack->num_banks, f) ==
+               (size_t)pack->num_banks &&
+           fwrite(sources, sizeof(PackSource), num_sources, f) ==
+               (size_t)num_sources &&
+           fwrite(variants, sizeof(int32_t), num_variants, f) ==
+               num_variants &&
+           fwrite(padding, 1, header->pcm_offset - end, f) ==
+               header->pcm_offset - end;
+  for (int i = 0; ok && i < num_clips; i++) {
+    size_t n = (size_t)unique[i]->frames * unique[i]->channels;
+    ok = fwrite(unique[i]->pcm, sizeof(short), n, f) == n;
+  }
+  if (fclose(f) != 0)
+    ok = 0;
+  f = NULL;
+  if (!ok || rename(tmp_path, out_path) != 0) {
+    fprintf(stderr, "Warning: Could not write %s: %s\n", out_path,
+            strerror(errno));
+    unlink(tmp_path);
+    goto out;
+  }
+  if (g_verbose)
+    printf("Wrote %s: %d clips, %.1f KiB PCM\n", out_path, num_clips,
+           header->pcm_bytes / 1024.0);
+  rc = 0;
+out:
+  if (f)
+    fclose(f);
+  free(header);
+  free(unique);
+  free(clips);
+  free(banks);
+  free(variants);
+  free(sources);
+  return rc;
+}
+
+static int valid_bank(int32_t index, uint32_t num_banks) {
+  return index == PACK_NO_BANK || (index >= 0 && (uint32_t)index < num_banks);
+}
+
+static int check_layout(const PackHeader *h, size_t size) {
+  if (memcmp(h->magic, PACK_MAGIC, 4) != 0 ||
+      h->version != PACK_FORMAT_VERSION || h->header_size != sizeof(*h) ||
+      h->params != pack_params())
+    return -1;
+  // Banks end up in PackKey's shorts
+  if (h->num_banks > SHRT_MAX ||
+      h->clips_offset + (uint64_t)h->num_clips * sizeof(PackClip) > size ||
+      h->banks_offset + (uint64_t)h->num_banks * sizeof(PackBankEntry) >
+          size ||
+      h->variants_offset + (uint64_t)h->num_variants * sizeof(int32_t) >
+          size ||
+      h->sources_offset + (uint64_t)h->num_sources * sizeof(PackSource) >
+          size ||
+      h->pcm_offset % PCM_ALIGN != 0 || h->pcm_offset > size ||
+      h->pcm_bytes > size - h->pcm_offset)
+    return -1;
+  const PackClip *clips =
+      (const PackClip *)((const char *)h + h->clips_offset);
+  uint64_t samples = h->pcm_bytes / sizeof(short);
+  for (uint32_t i = 0; i < h->num_clips; i++) {
+    if (clips[i].channels < 1 || clips[i].channels > ENGINE_CHANNELS ||
+        clips[i].offset > samples ||
+        (uint64_t)clips[i].frames * clips[i].channels >
+            samples - clips[i].offset)
+      return -1;
+  }
+  const PackBankEntry *banks =
+      (const PackBankEntry *)((const char *)h + h->banks_offset);
+  for (uint32_t i = 0; i < h->num_banks; i++) {
+    if ((uint64_t)banks[i].first + banks[i].count > h->num_variants)
+      return -1;
+  }
+  const int32_t *variants =
+      (const int32_t *)((const char *)h + h->variants_offset);
+  for (uint32_t i = 0; i < h->num_variants; i++) {
+    if (variants[i] < 0 || (uint32_t)variants[i] >= h->num_clips)
+      return -1;
+  }
+  for (int key = 0; key < PACK_KEYS; key++) {
+    if (!valid_bank(h->key_press[key], h->num_banks) ||
+        !valid_bank(h->key_release[key], h->num_banks))
+      return -1;
+  }
+  if (!valid_bank(h->generic_press, h->num_banks) ||
+      !valid_bank(h->release, h->num_banks))
+    return -1;
+  return 0;
+}
+
+// A cache must match its sources exactly. A bundle is copied around with
+// its pack, so only sources that are present and changed size make it stale.
+static int sources_fresh(const PackHeader *h, const char *config_dir,
+                         int strict) {
+  const PackSource *sources =
+      (const PackSource *)((const char *)h + h->sources_offset);
+  for (uint32_t i = 0; i < h->num_sources; i++) {
+    char path[1300];
+    const PackSource *s = &sources[i];
+    if (memchr(s->path, '\0', sizeof(s->path)) == NULL)
+      return 0;
+    if (s->path[0] == '/')
+      safe_strncpy(path, s->path, sizeof(path));
+    else if (!safe_snprintf(path, sizeof(path), "%s/%s", config_dir, s->path))
+      return 0;
+    struct stat st;
+    if (stat(path, &st) != 0) {
+      if (strict)
+        return 0;
+      continue;
+    }
+    int64_t mtime_ns =
+        (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    if ((strict && mtime_ns != s->mtime_ns) ||
+        (int64_t)st.st_size != s->size) {
+      if (g_verbose)
+        printf("Pack source changed: %s\n", path);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void set_clip(AudioClip *out, const PackHeader *h, int32_t index) {
+  const PackClip *c =
+      (const PackClip *)((const char *)h + h->clips_offset) + index;
+  short *pcm = (short *)((char *)h + h->pcm_offset);
+  out->pcm = pcm + c->offset;
+  out->frames = c->frames;
+  out->channels = c->channels;
+  out->samplerate = ENGINE_SAMPLE_RATE;
+}
+
+int map_pack_file(SoundPack *pack, const char *path, const char *config_dir,
+                  int strict) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PackHeader)) {
+    close(fd);
+    return -1;
+  }
+  size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+  const PackHeader *h = map;
+  if (check_layout(h, size) != 0) {
+    if (g_verbose)
+      printf("Ignoring %s: not a compatible pack file\n", path);
+    munmap(map, size);
+    return -1;
+  }
+  if (!sources_fresh(h, config_dir, strict)) {
+    munmap(map, size);
+    return -1;
+  }
+  posix_madvise(map, size, POSIX_MADV_WILLNEED);
+  // The clip table becomes the sound table, so indices carry over as is
+  pack->mapping = map;
+  pack->mapping_size = size;
+  pack->is_multi = (h->flags & PACK_FLAG_MULTI) != 0;
+  int rc = 0;
+  for (uint32_t i = 0; rc == 0 && i < h->num_clips; i++) {
+    AudioClip clip;
+    set_clip(&clip, h, (int32_t)i);
+    if (sound_pack_add_clip(pack, &clip) == NO_SOUND)
+      rc = -1;
+  }
+  // Banks that lost every variant when the pack was built are all empty
+  // and become one, so bank indices are translated
+  const PackBankEntry *banks =
+      (const PackBankEntry *)((const char *)h + h->banks_offset);
+  const int32_t *variants =
+      (const int32_t *)((const char *)h + h->variants_offset);
+  int *bank_map = malloc((h->num_banks + 1) * sizeof(int));
+  if (!bank_map)
+    rc = -1;
+  for (uint32_t i = 0; rc == 0 && i < h->num_banks; i++) {
+    bank_map[i] = sound_pack_add_bank(pack, variants + banks[i].first,
+                                      (int)banks[i].count);
+    if (bank_map[i] == NO_SOUND)
+      rc = -1;
+  }
+  for (int key = 0; rc == 0 && key < PACK_KEYS; key++) {
+    if (h->key_press[key] != PACK_NO_BANK)
+      rc |= sound_pack_set_key(pack, key, 0, bank_map[h->key_press[key]]);
+    if (h->key_release[key] != PACK_NO_BANK)
+      rc |= sound_pack_set_key(pack, key, 1, bank_map[h->key_release[key]]);
+  }
+  if (rc == 0) {
+    if (h->generic_press != PACK_NO_BANK)
+      pack->generic_press = bank_map[h->generic_press];
+    if (h->release != PACK_NO_BANK)
+      pack->release = bank_map[h->release];
+  }
+  free(bank_map);
+  if (rc != 0) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    sound_pack_clear(pack);
+    return -1;
+  }
+  return 0;
+}
+
+// ~/.cache/vbx/<hash of the config path>.vbxpack
+static int cache_path_for(const char *config_path, char *out, size_t size) {
+  char dir[1024];
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  if (xdg && xdg[0]) {
+    if (!safe_snprintf(dir, sizeof(dir), "%s", xdg))
+      return -1;
+  } else {
+    const char *home = get_home_dir();
+    if (!home || !safe_snprintf(dir, sizeof(dir), "%s/.cache", home))
+      return -1;
+  }
+  mkdir(dir, 0755);
+  if (strlen(dir) + 4 >= sizeof(dir))
+    return -1;
+  strcat(dir, "/vbx");
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    return -1;
+  char real[PATH_MAX];
+  const char *key = realpath(config_path, real) ? real : config_path;
+  uint64_t hash = fnv1a(FNV1A_OFFSET, key, strlen(key));
+  return safe_snprintf(out, size, "%s/%016llx.vbxpack", dir,
+                       (unsigned long long)hash)
+             ? 0
+             : -1;
+}
+
+static SoundPack *load_pack(const char *config_path) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  SoundPack *pack = sound_pack_new();
+  if (!pack) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return NULL;
+  }
+  char config_dir[1024];
+  config_dir_of(config_path, config_dir, sizeof(config_dir));
+  char bundle[1100];
+  if (safe_snprintf(bundle, sizeof(bundle), "%s/%s", config_dir,
+                    PACK_BUNDLE_NAME) &&
+      map_pack_file(pack, bundle, config_dir, 0) == 0) {
+    load_stats.mapped++;
+    load_stats.load_ms += elapsed_ms(&start);
+    if (g_verbose)
+      printf("Loaded %s in %.2f ms\n", bundle, elapsed_ms(&start));
+    return pack;
+  }
+  char cache[1100];
+  int use_cache = g_audio_settings.cache &&
+                  cache_path_for(config_path, cache, sizeof(cache)) == 0;
+  if (use_cache && map_pack_file(pack, cache, config_dir, 1) == 0) {
+    load_stats.mapped++;
+    load_stats.load_ms += elapsed_ms(&start);
+    if (g_verbose)
+      printf("Loaded %s from cache in %.2f ms\n", config_path,
+             elapsed_ms(&start));
+    return pack;
+  }
+  if (load_sound_config(pack, config_path) != 0 ||
+      decode_sound_pack(pack) != 0) {
+    sound_pack_free(pack);
+    return NULL;
+  }
+  load_stats.decoded++;
+  load_stats.load_ms += elapsed_ms(&start);
+  if (g_verbose)
+    printf("Decoded %s in %.1f ms\n", config_path, elapsed_ms(&start));
+  if (use_cache && !pack->lazy)
+    write_pack_file(pack, config_path, cache);
+  return pack;
+}
+
+SoundPack *load_sound_pack(const char *config_path) {
+  VBX_PROBE2(pack_load_start, config_path, latency_now_us());
+  SoundPack *pack = load_pack(config_path);
+  VBX_PROBE3(pack_load_end, config_path, pack != NULL, latency_now_us());
+  return pack;
+}
+
+void pack_get_load_stats(PackLoadStats *out) { *out = load_stats; }
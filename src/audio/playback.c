@@ -1,218 +1,580 @@
 #include "audio/playback.h"
+#include "audio/intern.h"
+#include "audio/log.h"
+#include "audio/mixer.h"
+#include "audio/resample.h"
+#include "audio/sample_cache.h"
+#include "audio/settings.h"
+#include "audio/soundpack.h"
+#include "audio/trim.h"
 #include "audio/types.h"
+#include "common/realtime.h"
+#include "common/spsc.h"
 #include "common/utils.h"
 #include <json-c/json.h>
+#include <math.h>
 #include <pthread.h>
-#include <pulse/error.h>
-#include <pulse/simple.h>
+#include <semaphore.h>
 #include <sndfile.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-pthread_t sound_threads[MAX_CONCURRENT_SOUNDS];
-volatile int thread_active[MAX_CONCURRENT_SOUNDS] = {0};
-pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define EVENT_RING_SIZE 1024
+#define NUM_PITCHES ((int)(sizeof(pitch_cents) / sizeof(pitch_cents[0])))
 
-int init_audio() {
-  if (g_sound_pack.is_multi)
-    return 0;
-  if (strlen(g_sound_pack.sound_file) == 0) {
-    fprintf(stderr, "Error: No sound file specified in sound pack config\n");
-    fprintf(stderr, "Check that your sound pack has a valid config.json file.\n");
+// Pitch variants of random_pitch packs, in cents from the original
+static const int pitch_cents[] = {-70, -35, 35, 70};
+
+// One parsed input event, as queued from the stdin reader
+typedef struct {
+  int key_code;
+  int is_pressed;
+  EventTimes times;
+} KeyEvent;
+
+static SpscRing event_ring;
+static sem_t event_ready;
+static pthread_t playback_thread;
+static volatile int playback_running = 0;
+static unsigned long events_received = 0;
+static unsigned long events_dropped = 0;
+static SoundPack *keyboard_pack = NULL;
+static SoundPack *mouse_pack = NULL;
+static uint32_t variation_state = 1;
+
+typedef struct {
+  sf_count_t start;
+  sf_count_t frames;
+  sf_count_t offset;
+} SegmentRange;
+
+static int compare_segment_start(const void *a, const void *b) {
+  const SegmentRange *ra = *(const SegmentRange *const *)a;
+  const SegmentRange *rb = *(const SegmentRange *const *)b;
+  return (ra->start > rb->start) - (ra->start < rb->start);
+}
+
+// Bring the decoded segments to the engine format, one range at a time so
+// the filter never reads into a neighbouring key's sound
+static int convert_segments(SoundPack *pack, const SF_INFO *info,
+                            SegmentRange **order, int num_ranges) {
+  int out_channels = resample_channels(info->channels);
+  sf_count_t total = 0;
+  for (int i = 0; i < num_ranges; i++)
+    total += resample_frames((long)order[i]->frames, info->samplerate);
+  short *pcm = calloc(total * out_channels, sizeof(short));
+  if (!pcm) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
     return -1;
   }
-  if (access(g_sound_pack.sound_file, R_OK) != 0) {
-    fprintf(stderr, "Sound file not accessible: %s\n", g_sound_pack.sound_file);
-    perror("access");
-    return -1;
+  sf_count_t offset = 0;
+  for (int i = 0; i < num_ranges; i++) {
+    SegmentRange *r = order[i];
+    long frames = resample_frames((long)r->frames, info->samplerate);
+    if (r->frames > 0 &&
+        resample_to_engine(pcm + offset * out_channels,
+                           pack->samples + r->offset * info->channels,
+                           (long)r->frames, info->channels,
+                           info->samplerate) != 0) {
+      free(pcm);
+      fprintf(stderr, "Error: Could not resample %s\n",
+              sound_pack_string(pack, pack->sound_file));
+      return -1;
+    }
+    r->offset = offset;
+    r->frames = r->frames > 0 ? frames : 0;
+    offset += frames;
   }
-  SNDFILE *test_sf =
-      sf_open(g_sound_pack.sound_file, SFM_READ, &g_sound_pack.sf_info);
-  if (!test_sf) {
-    fprintf(stderr, "Could not open sound file: %s\n", g_sound_pack.sound_file);
+  free(pack->samples);
+  pack->samples = pcm;
+  pack->sample_frames = (long)total;
+  return 0;
+}
+
+// Decode the range of every sound into the pack's sample arena so that
+// playback never touches libsndfile. Ranges are read in file order to avoid
+// backward seeks.
+static int decode_key_segments(SoundPack *pack) {
+  const char *path = sound_pack_string(pack, pack->sound_file);
+  SF_INFO info = {0};
+  SNDFILE *sf = sf_open(path, SFM_READ, &info);
+  if (!sf) {
+    fprintf(stderr, "Could not open sound file: %s\n", path);
     fprintf(stderr, "libsndfile error: %s\n", sf_strerror(NULL));
     return -1;
   }
-  sf_close(test_sf);
+  SegmentRange *ranges = calloc(pack->num_sounds + 1, sizeof(*ranges));
+  SegmentRange **order = calloc(pack->num_sounds + 1, sizeof(*order));
+  if (!ranges || !order) {
+    free(ranges);
+    free(order);
+    sf_close(sf);
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return -1;
+  }
+  int num_ranges = 0;
+  for (int i = 0; i < pack->num_sounds; i++) {
+    const PackSound *s = &pack->sounds[i];
+    sf_count_t start = ((sf_count_t)s->start_ms * info.samplerate) / 1000;
+    sf_count_t frames = ((sf_count_t)s->duration_ms * info.samplerate) / 1000;
+    if (info.frames > 0) {
+      if (start >= info.frames)
+        continue;
+      if (start + frames > info.frames)
+        frames = info.frames - start;
+    }
+    if (start < 0 || frames <= 0)
+      continue;
+    ranges[i].start = start;
+    ranges[i].frames = frames;
+    order[num_ranges++] = &ranges[i];
+  }
+  qsort(order, num_ranges, sizeof(order[0]), compare_segment_start);
+  sf_count_t total = 0;
+  for (int i = 0; i < num_ranges; i++) {
+    order[i]->offset = total;
+    total += order[i]->frames;
+  }
+  free(pack->samples);
+  pack->samples = NULL;
+  pack->sample_frames = 0;
+  if (total > 0) {
+    pack->samples = calloc(total * info.channels, sizeof(short));
+    if (!pack->samples) {
+      free(ranges);
+      free(order);
+      sf_close(sf);
+      fprintf(stderr, "Error: Memory allocation failed\n");
+      return -1;
+    }
+  }
+  for (int i = 0; i < num_ranges; i++) {
+    SegmentRange *r = order[i];
+    sf_seek(sf, r->start, SEEK_SET);
+    sf_count_t read = sf_readf_short(
+        sf, pack->samples + r->offset * info.channels, r->frames);
+    // A short read leaves zeroed frames; trim them so they are not played
+    r->frames = read > 0 ? read : 0;
+  }
+  sf_close(sf);
+  pack->sample_frames = (long)total;
+  int channels = info.channels;
+  int samplerate = info.samplerate;
+  if (total > 0 && resample_needed(channels, samplerate)) {
+    if (convert_segments(pack, &info, order, num_ranges) != 0) {
+      free(ranges);
+      free(order);
+      return -1;
+    }
+    channels = resample_channels(channels);
+    samplerate = ENGINE_SAMPLE_RATE;
+  }
+  for (int i = 0; i < pack->num_sounds; i++) {
+    AudioClip *clip = &pack->sounds[i].clip;
+    memset(clip, 0, sizeof(*clip));
+    if (ranges[i].frames <= 0)
+      continue;
+    clip->pcm = pack->samples + ranges[i].offset * channels;
+    clip->frames = (long)ranges[i].frames;
+    clip->channels = channels;
+    clip->samplerate = samplerate;
+    // Ranges do not overlap, so each can be trimmed within its own span
+    trim_clip(clip);
+  }
   if (g_verbose) {
     printf("Sound file info: %ld frames, %d channels, %d Hz\n",
-           g_sound_pack.sf_info.frames, g_sound_pack.sf_info.channels,
-           g_sound_pack.sf_info.samplerate);
+           (long)info.frames, info.channels, info.samplerate);
+    printf("Decoded %d segments (%ld frames, %.1f KiB) from %s\n", num_ranges,
+           pack->sample_frames,
+           pack->sample_frames * channels * sizeof(short) / 1024.0, path);
+  }
+  free(ranges);
+  free(order);
+  return 0;
+}
+
+AudioClip *decode_clip_file(const char *path) {
+  SF_INFO sf_info = {0};
+  SNDFILE *sf = sf_open(path, SFM_READ, &sf_info);
+  if (!sf) {
+    fprintf(stderr, "Error: Could not open sound file: %s\n", path);
+    fprintf(stderr, "Details: %s\n", sf_strerror(NULL));
+    fprintf(stderr, "Check that the audio file exists and is readable.\n");
+    return NULL;
+  }
+  sf_count_t capacity = sf_info.frames > 0 ? sf_info.frames : 4096;
+  AudioClip *clip = calloc(1, sizeof(AudioClip));
+  short *pcm = malloc(capacity * sf_info.channels * sizeof(short));
+  if (!clip || !pcm) {
+    free(clip);
+    free(pcm);
+    sf_close(sf);
+    return NULL;
+  }
+  sf_count_t total = 0;
+  while (1) {
+    if (total == capacity) {
+      capacity *= 2;
+      short *grown = realloc(pcm, capacity * sf_info.channels * sizeof(short));
+      if (!grown)
+        break;
+      pcm = grown;
+    }
+    sf_count_t read = sf_readf_short(sf, pcm + total * sf_info.channels,
+                                     capacity - total);
+    if (read <= 0)
+      break;
+    total += read;
+  }
+  sf_close(sf);
+  clip->pcm = pcm;
+  clip->frames = (long)total;
+  clip->channels = sf_info.channels;
+  clip->samplerate = sf_info.samplerate;
+  if (total > 0 && resample_needed(clip->channels, clip->samplerate)) {
+    long frames = resample_frames(clip->frames, clip->samplerate);
+    int channels = resample_channels(clip->channels);
+    short *converted = malloc(frames * channels * sizeof(short));
+    if (!converted || resample_to_engine(converted, pcm, clip->frames,
+                                         clip->channels,
+                                         clip->samplerate) != 0) {
+      fprintf(stderr, "Error: Could not resample %s\n", path);
+      free(converted);
+      free_audio_clip(clip);
+      return NULL;
+    }
+    free(pcm);
+    clip->pcm = converted;
+    clip->frames = frames;
+    clip->channels = channels;
+    clip->samplerate = ENGINE_SAMPLE_RATE;
+  }
+  long frames = clip->frames;
+  trim_clip(clip);
+  if (clip->frames > 0 && clip->frames < frames) {
+    short *shrunk =
+        realloc(clip->pcm, clip->frames * clip->channels * sizeof(short));
+    if (shrunk)
+      clip->pcm = shrunk;
+  }
+  return clip;
+}
+
+// Multi mode: decode every file the pack references once. Files with the
+// same contents, under any path and in either pack, share one interned
+// clip; a file that fails to decode leaves its keys silent rather than
+// failing the whole pack.
+static int decode_multi_files(SoundPack *pack) {
+  InternStats before, after;
+  intern_get_stats(&before);
+  for (int i = 0; i < pack->num_sounds; i++) {
+    const AudioClip *clip = intern_clip_file(sound_pack_path(pack, i));
+    if (clip)
+      pack->sounds[i].clip = *clip;
+    else
+      memset(&pack->sounds[i].clip, 0, sizeof(AudioClip));
   }
+  intern_get_stats(&after);
+  if (g_verbose)
+    printf("Decoded %u sound files for %u paths, %.1f KiB shared with "
+           "identical files\n",
+           after.clips - before.clips, after.paths - before.paths,
+           (after.bytes_shared - before.bytes_shared) / 1024.0);
   return 0;
 }
 
-void *play_sound_thread(void *arg) {
-  PlaybackData *data = (PlaybackData *)arg;
-  int key_code = data->key_code;
-  int thread_id = data->thread_id;
-  int is_pressed = data->is_pressed;
-  const char *file_to_play = NULL;
+// Letters, space, backspace and enter cover most of what is typed
+static const int prefetch_keys[] = {57, 14, 28, 30, 31, 32, 33, 34, 35, 36,
+                                    37, 38, 16, 17, 18, 19, 20, 21, 22, 23,
+                                    24, 25, 44, 45, 46, 47, 48, 49, 50};
 
-  int is_mouse_event = (key_code == 272 || key_code == 273 || key_code == 274);
-  SoundPack *sound_pack = is_mouse_event ? &g_mouse_sound_pack : &g_sound_pack;
-  float volume = is_mouse_event ? g_mouse_volume : g_volume;
-  int mute_state = is_mouse_event ? g_mouse_mute : g_keyboard_mute;
+// Decoded size of every sound of a multi pack, from the file headers alone
+static size_t estimate_multi_bytes(const SoundPack *pack) {
+  size_t total = 0;
+  for (int i = 0; i < pack->num_sounds; i++) {
+    SF_INFO info = {0};
+    SNDFILE *sf = sf_open(sound_pack_path(pack, i), SFM_READ, &info);
+    if (!sf)
+      continue;
+    sf_close(sf);
+    total += (size_t)resample_frames((long)info.frames, info.samplerate) *
+             resample_channels(info.channels) * sizeof(short);
+  }
+  return total;
+}
 
+static int prefetch_bank(const SoundPack *pack, int bank) {
+  if (bank == NO_SOUND)
+    return 0;
+  const PackBank *b = &pack->banks[bank];
+  for (int i = 0; i < b->count; i++) {
+    int sound = pack->variants[b->first + i];
+    if (sample_cache_prefetch(sound_pack_path(pack, sound)) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Leave the clips empty and decode through the sample cache on first use,
+// warming it with the sounds of the most typed keys
+static void start_lazy_pack(SoundPack *pack, size_t estimate) {
+  pack->lazy = 1;
+  for (int i = 0; i < pack->num_sounds; i++)
+    memset(&pack->sounds[i].clip, 0, sizeof(AudioClip));
+  int full = prefetch_bank(pack, pack->generic_press) != 0 ||
+             prefetch_bank(pack, pack->release) != 0;
+  int n = (int)(sizeof(prefetch_keys) / sizeof(prefetch_keys[0]));
+  for (int i = 0; !full && i < n; i++) {
+    const PackKey *key = sound_pack_find_key(pack, prefetch_keys[i]);
+    if (key)
+      full = prefetch_bank(pack, key->press) != 0 ||
+             prefetch_bank(pack, key->release) != 0;
+  }
   if (g_verbose) {
-    printf("Thread %d: Playing %s sound for key %d (%s)\n", thread_id,
-           is_mouse_event ? "mouse" : "keyboard", key_code,
-           is_pressed ? "press" : "release");
+    SampleCacheStats stats;
+    sample_cache_get_stats(&stats);
+    printf("Pack needs %.1f MiB decoded, over the %.0f MiB sample cache: "
+           "decoding on first use, %u files prefetched\n",
+           estimate / 1048576.0, stats.budget / 1048576.0, stats.entries);
+    if (pack->random_pitch)
+      printf("random_pitch is ignored for packs decoded on first use\n");
   }
+}
 
-  if (g_mute || mute_state) {
-    if (g_verbose) {
-      printf("Thread %d: %s sound is muted\n", thread_id,
-             is_mouse_event ? "Mouse" : "Keyboard");
+// Render every decoded sound at each of pitch_cents into one block, as new
+// sounds; pitched[p * base + s] is the variant of sound s at pitch p
+static int render_pitch_variants(SoundPack *pack, int *pitched) {
+  int base = pack->num_sounds;
+  int rates[NUM_PITCHES];
+  size_t total = 0;
+  for (int p = 0; p < NUM_PITCHES; p++) {
+    // Played back at the engine rate, a clip resampled from a higher rate
+    // is shorter and higher by the same ratio
+    rates[p] = (int)lround(ENGINE_SAMPLE_RATE *
+                           pow(2.0, pitch_cents[p] / 1200.0));
+    for (int s = 0; s < base; s++) {
+      const AudioClip *clip = &pack->sounds[s].clip;
+      if (clip->frames > 0)
+        total += (size_t)resample_frames(clip->frames, rates[p]) *
+                 clip->channels;
     }
-    goto exit_cleanup;
-  }
-  if (sound_pack->is_multi) {
-    if (is_pressed && sound_pack->multi_key_mappings[key_code].press)
-      file_to_play = sound_pack->multi_key_mappings[key_code].press;
-    else if (!is_pressed && sound_pack->multi_key_mappings[key_code].release)
-      file_to_play = sound_pack->multi_key_mappings[key_code].release;
-    else if (is_pressed && sound_pack->num_generic_press_files > 0) {
-      int idx = rand() % sound_pack->num_generic_press_files;
-      file_to_play = sound_pack->generic_press_files[idx];
-    } else if (!is_pressed && strlen(sound_pack->release_file) > 0)
-      file_to_play = sound_pack->release_file;
-    if (!file_to_play) {
-      if (g_verbose) {
-        printf("Thread %d: No sound file found for key %d (%s)\n", thread_id,
-               key_code, is_pressed ? "press" : "release");
+  }
+  short *pcm = total > 0 ? malloc(total * sizeof(short)) : NULL;
+  if (total > 0 && !pcm) {
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return -1;
+  }
+  free(pack->variant_samples);
+  pack->variant_samples = pcm;
+  size_t offset = 0;
+  for (int p = 0; p < NUM_PITCHES; p++) {
+    for (int s = 0; s < base; s++) {
+      // By value: adding a sound may move the sound table
+      AudioClip clip = pack->sounds[s].clip;
+      pitched[p * base + s] = NO_SOUND;
+      if (clip.frames <= 0)
+        continue;
+      AudioClip variant = {.pcm = pcm + offset,
+                           .frames = resample_frames(clip.frames, rates[p]),
+                           .channels = clip.channels,
+                           .samplerate = ENGINE_SAMPLE_RATE};
+      if (resample_to_engine(variant.pcm, clip.pcm, clip.frames,
+                             clip.channels, rates[p]) != 0 ||
+          (pitched[p * base + s] = sound_pack_add_clip(pack, &variant)) ==
+              NO_SOUND) {
+        fprintf(stderr, "Error: Could not render pitch variants\n");
+        return -1;
       }
-      goto exit_cleanup;
-    }
-    if (g_verbose) {
-      printf("Thread %d: Using sound file: %s\n", thread_id, file_to_play);
-    }
-    SF_INFO sf_info = {0};
-    SNDFILE *sf = sf_open(file_to_play, SFM_READ, &sf_info);
-    if (!sf) {
-      fprintf(stderr, "Error: Could not open sound file: %s\n", file_to_play);
-      fprintf(stderr, "Details: %s\n", sf_strerror(NULL));
-      fprintf(stderr, "Check that the audio file exists and is readable.\n");
-      goto exit_cleanup;
+      offset += (size_t)variant.frames * variant.channels;
     }
-    pa_sample_spec ss = {.format = PA_SAMPLE_S16LE,
-                         .rate = sf_info.samplerate,
-                         .channels = sf_info.channels};
-    int pa_error;
-    pa_simple *pa_handle =
-        pa_simple_new(NULL, "KeyboardSounds", PA_STREAM_PLAYBACK, NULL,
-                      "playback", &ss, NULL, NULL, &pa_error);
-    if (!pa_handle) {
-      fprintf(stderr, "Could not initialize PulseAudio: %s\n",
-              pa_strerror(pa_error));
-      sf_close(sf);
-      goto exit_cleanup;
-    }
-    int frames = 2048;
-    short *buffer = malloc(frames * sf_info.channels * sizeof(short));
-    if (!buffer) {
-      pa_simple_free(pa_handle);
-      sf_close(sf);
-      goto exit_cleanup;
+  }
+  if (g_verbose)
+    printf("Rendered %d pitch variants (%.1f KiB)\n", pack->num_sounds - base,
+           total * sizeof(short) / 1024.0);
+  return 0;
+}
+
+// Drop variants that did not decode, so that only a key with nothing to
+// play has an empty bank, and add the pitch variants of random_pitch packs
+static int finish_banks(SoundPack *pack) {
+  int base = pack->num_sounds;
+  int num_pitches = pack->random_pitch ? NUM_PITCHES : 0;
+  int *pitched = NULL;
+  if (num_pitches > 0) {
+    pitched = calloc((size_t)base * num_pitches + 1, sizeof(int));
+    if (!pitched || render_pitch_variants(pack, pitched) != 0) {
+      free(pitched);
+      return -1;
     }
-    sf_count_t read;
-    while ((read = sf_readf_short(sf, buffer, frames)) > 0) {
-      for (sf_count_t i = 0; i < read * sf_info.channels; i++) {
-        buffer[i] = (short)(buffer[i] * volume);
-      }
-      int pa_write_error;
-      if (pa_simple_write(pa_handle, buffer,
-                          read * sf_info.channels * sizeof(short),
-                          &pa_write_error) < 0) {
-        fprintf(stderr, "PulseAudio write error: %s\n",
-                pa_strerror(pa_write_error));
-        break;
+  }
+  int capacity = pack->num_variants * (num_pitches + 1) + 1;
+  int *variants = malloc(capacity * sizeof(int));
+  if (!variants) {
+    free(pitched);
+    fprintf(stderr, "Error: Memory allocation failed\n");
+    return -1;
+  }
+  int n = 0;
+  for (int b = 0; b < pack->num_banks; b++) {
+    PackBank *bank = &pack->banks[b];
+    int first = n;
+    for (int p = -1; p < num_pitches; p++) {
+      for (int i = 0; i < bank->count; i++) {
+        int sound = pack->variants[bank->first + i];
+        if (p >= 0)
+          sound = pitched[p * base + sound];
+        if (sound != NO_SOUND && pack->sounds[sound].clip.frames > 0)
+          variants[n++] = sound;
       }
     }
-    int pa_drain_error;
-    pa_simple_drain(pa_handle, &pa_drain_error);
-    pa_simple_free(pa_handle);
-    sf_close(sf);
-    free(buffer);
+    bank->first = first;
+    bank->count = n - first;
+  }
+  free(pitched);
+  free(pack->variants);
+  pack->variants = variants;
+  pack->num_variants = n;
+  pack->variants_capacity = capacity;
+  return 0;
+}
+
+// Latency and voice time the trimming saved on this pack's clips
+static void print_trim_stats(const TrimStats *before, const TrimStats *after) {
+  unsigned long trimmed = after->trimmed - before->trimmed;
+  double lead_ms = after->lead_ms - before->lead_ms;
+  double removed_ms = lead_ms + after->tail_ms - before->tail_ms;
+  double total_ms = after->total_ms - before->total_ms;
+  if (trimmed == 0 || total_ms <= 0.0)
+    return;
+  printf("Trimmed silence from %lu of %lu clips: %.2f ms less lead-in on "
+         "average, %.0f of %.0f ms voice time (%.0f%%) saved\n",
+         trimmed, after->clips - before->clips, lead_ms / trimmed, removed_ms,
+         total_ms, 100.0 * removed_ms / total_ms);
+}
+
+int decode_sound_pack(SoundPack *pack) {
+  ResampleStats before, after;
+  resample_get_stats(&before);
+  TrimStats trim_before, trim_after;
+  trim_get_stats(&trim_before);
+  size_t budget = sample_cache_budget();
+  size_t estimate = 0;
+  if (pack->is_multi && budget > 0 &&
+      (estimate = estimate_multi_bytes(pack)) > budget) {
+    start_lazy_pack(pack, estimate);
+  } else if (pack->is_multi) {
+    if (decode_multi_files(pack) != 0)
+      return -1;
   } else {
-    if (key_code >= 512 ||
-        sound_pack->key_mappings[key_code].duration_ms == 0) {
-      if (g_verbose) {
-        printf("Thread %d: No mapping for key %d\n", thread_id, key_code);
-      }
-      goto exit_cleanup;
+    const char *path = sound_pack_string(pack, pack->sound_file);
+    if (!path || strlen(path) == 0) {
+      fprintf(stderr, "Error: No sound file specified in sound pack config\n");
+      fprintf(stderr,
+              "Check that your sound pack has a valid config.json file.\n");
+      return -1;
     }
-    SoundMapping *mapping = &sound_pack->key_mappings[key_code];
-    SF_INFO sf_info = sound_pack->sf_info;
-    SNDFILE *sf = sf_open(sound_pack->sound_file, SFM_READ, &sf_info);
-    if (!sf) {
-      fprintf(stderr, "Thread: Could not open sound file\n");
-      goto exit_cleanup;
+    if (access(path, R_OK) != 0) {
+      fprintf(stderr, "Sound file not accessible: %s\n", path);
+      perror("access");
+      return -1;
     }
-    pa_sample_spec ss = {.format = PA_SAMPLE_S16LE,
-                         .rate = sf_info.samplerate,
-                         .channels = sf_info.channels};
-    int pa_error;
-    pa_simple *pa_handle =
-        pa_simple_new(NULL, "KeyboardSounds", PA_STREAM_PLAYBACK, NULL,
-                      "playback", &ss, NULL, NULL, &pa_error);
-    if (!pa_handle) {
-      sf_close(sf);
-      fprintf(stderr, "Thread: Could not initialize PulseAudio: %s\n",
-              pa_strerror(pa_error));
-      goto exit_cleanup;
-    }
-    sf_count_t start_frame = (mapping->start_ms * sf_info.samplerate) / 1000;
-    sf_count_t duration_frames =
-        (mapping->duration_ms * sf_info.samplerate) / 1000;
-    sf_seek(sf, start_frame, SEEK_SET);
-    short *buffer = malloc(duration_frames * sf_info.channels * sizeof(short));
-    if (!buffer) {
-      pa_simple_free(pa_handle);
-      sf_close(sf);
-      goto exit_cleanup;
-    }
-    sf_count_t frames_read = sf_readf_short(sf, buffer, duration_frames);
-    for (sf_count_t i = 0; i < frames_read * sf_info.channels; i++) {
-      buffer[i] = (short)(buffer[i] * volume);
-    }
-    int pa_write_error, pa_drain_error;
-    pa_simple_write(pa_handle, buffer,
-                    frames_read * sf_info.channels * sizeof(short),
-                    &pa_write_error);
-    pa_simple_drain(pa_handle, &pa_drain_error);
-    free(buffer);
-    pa_simple_free(pa_handle);
-    sf_close(sf);
+    if (decode_key_segments(pack) != 0)
+      return -1;
   }
-exit_cleanup:
-  pthread_mutex_lock(&thread_mutex);
-  thread_active[thread_id] = 0;
-  pthread_mutex_unlock(&thread_mutex);
-  free(data);
-  return NULL;
+  if (!pack->lazy && finish_banks(pack) != 0)
+    return -1;
+  resample_get_stats(&after);
+  if (g_verbose && after.clips > before.clips) {
+    printf("Resampled %lu clips to %d Hz in %.1f ms (%.1f KiB -> %.1f KiB)\n",
+           after.clips - before.clips, ENGINE_SAMPLE_RATE,
+           after.milliseconds - before.milliseconds,
+           (after.bytes_in - before.bytes_in) / 1024.0,
+           (after.bytes_out - before.bytes_out) / 1024.0);
+  }
+  trim_get_stats(&trim_after);
+  if (g_verbose)
+    print_trim_stats(&trim_before, &trim_after);
+  return 0;
+}
+
+static int has_bank(const SoundPack *pack, int bank) {
+  return bank != NO_SOUND && pack->banks[bank].count > 0;
+}
+
+// The bank a key event plays from: the key's own, else in multi mode the
+// pack's generic press or release bank
+static int event_bank(const SoundPack *pack, int key_code, int is_pressed) {
+  const PackKey *key = sound_pack_find_key(pack, key_code);
+  int bank = !key ? NO_SOUND : is_pressed ? key->press : key->release;
+  if (has_bank(pack, bank))
+    return bank;
+  if (!pack->is_multi)
+    return NO_SOUND;
+  bank = is_pressed ? pack->generic_press : pack->release;
+  return has_bank(pack, bank) ? bank : NO_SOUND;
 }
 
-int find_available_thread_slot() {
-  pthread_mutex_lock(&thread_mutex);
-  for (int i = 0; i < MAX_CONCURRENT_SOUNDS; i++) {
-    if (!thread_active[i]) {
-      pthread_mutex_unlock(&thread_mutex);
-      return i;
+// xorshift32; only the playback thread draws from it
+static uint32_t next_random(void) {
+  uint32_t x = variation_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return variation_state = x;
+}
+
+// Variants are ready to play, so picking one is all the variety costs. A
+// random pick is never the variant this key played last.
+static int choose_variant(SoundPack *pack, int bank, int key_code,
+                          int is_pressed) {
+  const PackBank *b = &pack->banks[bank];
+  short *last = &pack->last_variant[key_code][is_pressed ? 0 : 1];
+  int i = 0;
+  if (b->count > 1) {
+    if (g_audio_settings.variation == VARIATION_ROUND_ROBIN) {
+      i = (*last + 1) % b->count;
+    } else if (*last < 0 || *last >= b->count) {
+      i = (int)(next_random() % (uint32_t)b->count);
+    } else {
+      i = (int)(next_random() % (uint32_t)(b->count - 1));
+      if (i >= *last)
+        i++;
     }
   }
-  pthread_mutex_unlock(&thread_mutex);
-  return -1;
+  *last = (short)i;
+  return pack->variants[b->first + i];
 }
 
-void play_sound_segment(int key_code, int is_pressed) {
+// Clips of eager packs are decoded at load and shared, so nothing is
+// allocated here. Lazy packs lend a clip from the sample cache, which the
+// caller must give back with free_audio_clip().
+static AudioClip *load_event_clip(SoundPack *sound_pack, int key_code,
+                                  int is_pressed) {
+  int bank = event_bank(sound_pack, key_code, is_pressed);
+  int sound = bank != NO_SOUND
+                  ? choose_variant(sound_pack, bank, key_code, is_pressed)
+                  : NO_SOUND;
+  AudioClip *clip = NULL;
+  if (sound != NO_SOUND)
+    clip = sound_pack->lazy
+               ? sample_cache_get(sound_pack_path(sound_pack, sound))
+               : &sound_pack->sounds[sound].clip;
+  if (!clip || clip->frames == 0) {
+    VBX_LOG("No sound for key %d (%s)", key_code,
+            is_pressed ? "press" : "release");
+    return NULL;
+  }
+  return clip;
+}
+
+void play_sound_segment(int key_code, int is_pressed,
+                        const EventTimes *times) {
   if (g_mute) {
-    if (g_verbose) {
-      printf("Sound muted - ignoring key %d (%s)\n", key_code,
-             is_pressed ? "press" : "release");
-    }
+    VBX_LOG("Sound muted - ignoring key %d (%s)", key_code,
+            is_pressed ? "press" : "release");
     return;
   }
 
@@ -224,65 +586,66 @@ void play_sound_segment(int key_code, int is_pressed) {
     // For now, we'll add a simple check here
     extern int g_mouse_enabled;
     if (!g_mouse_enabled) {
-      if (g_verbose) {
-        printf("Mouse sounds disabled - ignoring mouse event %d\n", key_code);
-      }
+      VBX_LOG("Mouse sounds disabled - ignoring mouse event %d", key_code);
       return;
     }
   } else {
     // For keyboard events, check if keyboard is enabled
     extern int g_keyboard_enabled;
     if (!g_keyboard_enabled) {
-      if (g_verbose) {
-        printf("Keyboard sounds disabled - ignoring key %d\n", key_code);
-      }
+      VBX_LOG("Keyboard sounds disabled - ignoring key %d", key_code);
       return;
     }
   }
-  if (!g_sound_pack.is_multi && !is_pressed) {
-    if (g_verbose) {
-      printf("Single mode: Ignoring key release for key %d\n", key_code);
-    }
+  SoundPack *sound_pack = is_mouse_event ? mouse_pack : keyboard_pack;
+  if (!sound_pack)
     return;
-  }
-  int slot = find_available_thread_slot();
-  if (slot == -1) {
-    if (g_verbose) {
-      printf("Warning: No available thread slots\n");
-    }
+  if (key_code < 0 || key_code >= SOUND_PACK_KEYS)
+    return;
+  float volume = is_mouse_event ? g_mouse_volume : g_volume;
+  int mute_state = is_mouse_event ? g_mouse_mute : g_keyboard_mute;
+  VBX_LOG("Playing %s sound for key %d (%s)",
+          is_mouse_event ? "mouse" : "keyboard", key_code,
+          is_pressed ? "press" : "release");
+  if (mute_state) {
+    VBX_LOG("%s sound is muted", is_mouse_event ? "Mouse" : "Keyboard");
     return;
   }
-  PlaybackData *data = malloc(sizeof(PlaybackData));
-  if (!data)
+  AudioClip *clip = load_event_clip(sound_pack, key_code, is_pressed);
+  if (!clip) {
+    // Single-mode packs and most multi packs have no release sounds, but
+    // release_fade_ms still applies to them
+    if (!is_pressed && mixer_release(key_code) < 0)
+      VBX_LOG("Warning: Voice queue full, dropped key %d", key_code);
     return;
-  data->key_code = key_code;
-  data->thread_id = slot;
-  data->is_pressed = is_pressed;
-  pthread_mutex_lock(&thread_mutex);
-  thread_active[slot] = 1;
-  if (pthread_create(&sound_threads[slot], NULL, play_sound_thread, data) !=
-      0) {
-    thread_active[slot] = 0;
-    free(data);
-    fprintf(stderr, "Failed to create sound thread\n");
-  } else {
-    pthread_detach(sound_threads[slot]);
   }
-  pthread_mutex_unlock(&thread_mutex);
+  int priority = is_mouse_event ? VOICE_PRIORITY_MOUSE : VOICE_PRIORITY_KEYBOARD;
+  if (mixer_play(clip, volume, sound_pack->lazy, priority, key_code,
+                 !is_pressed, times) < 0) {
+    if (sound_pack->lazy)
+      free_audio_clip(clip);
+    VBX_LOG("Warning: Voice queue full, dropped key %d", key_code);
+  }
 }
 
 
+static uint64_t get_uint64(json_object *root, const char *key) {
+  json_object *o;
+  if (!json_object_object_get_ex(root, key, &o))
+    return 0;
+  int64_t value = json_object_get_int64(o);
+  return value > 0 ? (uint64_t)value : 0;
+}
+
 int parse_keyboard_event(const char *json_line, int *key_code,
-                         int *is_pressed) {
+                         int *is_pressed, EventTimes *times) {
   char *line_copy = xstrdup(json_line);
   if (!line_copy)
     return -1;
   char *newline = strchr(line_copy, '\n');
   if (newline)
     *newline = '\0';
-  if (g_verbose) {
-    printf("Parsing JSON: %s\n", line_copy);
-  }
+  VBX_LOG("Parsing JSON: %s", line_copy);
   json_object *root = json_tokener_parse(line_copy);
   free(line_copy);
   if (!root) {
@@ -294,13 +657,88 @@ int parse_keyboard_event(const char *json_line, int *key_code,
       json_object_object_get_ex(root, "state_code", &state_code_obj)) {
     *key_code = json_object_get_int(key_code_obj);
     *is_pressed = json_object_get_int(state_code_obj);
-    if (g_verbose) {
-      printf("Parsed key event: key_code=%d, is_pressed=%d\n", *key_code,
-             *is_pressed);
-    }
+    times->event_us = get_uint64(root, "time_usec");
+    times->sent_us = get_uint64(root, "sent_usec");
+    VBX_LOG("Parsed key event: key_code=%d, is_pressed=%d", *key_code,
+            *is_pressed);
     json_object_put(root);
     return 0;
   }
   json_object_put(root);
   return -1;
 }
+
+static void *playback_thread_main(void *arg) {
+  (void)arg;
+  // Lookups and mixer_play() are on the click path too. One step below the
+  // render thread, which must never wait for event handling, and unpinned.
+  const RealtimeSettings *rs = &g_audio_settings.realtime;
+  log_register_thread("playback");
+  if (rs->enabled)
+    realtime_setup_thread("playback", rs->priority > 1 ? rs->priority - 1 : 1,
+                          -1);
+  while (1) {
+    while (sem_wait(&event_ready) != 0)
+      ;
+    KeyEvent event;
+    while (spsc_pop(&event_ring, &event)) {
+      event.times.dequeued_us = latency_now_us();
+      play_sound_segment(event.key_code, event.is_pressed, &event.times);
+    }
+    mixer_reclaim();
+    if (!playback_running)
+      break;
+  }
+  return NULL;
+}
+
+int start_playback_thread(SoundPack *keyboard, SoundPack *mouse) {
+  keyboard_pack = keyboard;
+  mouse_pack = mouse;
+  variation_state = g_audio_settings.variation_seed;
+  if (variation_state == 0)
+    variation_state = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+  if (variation_state == 0)
+    variation_state = 1;
+  if (spsc_init(&event_ring, sizeof(KeyEvent), EVENT_RING_SIZE) != 0 ||
+      sem_init(&event_ready, 0, 0) != 0) {
+    fprintf(stderr, "Error: Could not create event queue\n");
+    return -1;
+  }
+  playback_running = 1;
+  if (pthread_create(&playback_thread, NULL, playback_thread_main, NULL) !=
+      0) {
+    fprintf(stderr, "Error: Could not start playback thread\n");
+    playback_running = 0;
+    return -1;
+  }
+  return 0;
+}
+
+int queue_key_event(int key_code, int is_pressed, const EventTimes *times) {
+  KeyEvent event = {key_code, is_pressed, *times};
+  events_received++;
+  if (!spsc_push(&event_ring, &event)) {
+    events_dropped++;
+    return -1;
+  }
+  sem_post(&event_ready);
+  return 0;
+}
+
+// Plays out whatever is still queued before returning
+void stop_playback_thread(void) {
+  if (!playback_running)
+    return;
+  playback_running = 0;
+  sem_post(&event_ready);
+  pthread_join(playback_thread, NULL);
+  sem_destroy(&event_ready);
+}
+
+void get_event_queue_stats(EventQueueStats *out) {
+  out->capacity = spsc_capacity(&event_ring);
+  out->high_water = spsc_high_water(&event_ring);
+  out->received = events_received;
+  out->dropped = events_dropped;
+}
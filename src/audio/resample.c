@@ -0,0 +1,168 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/resample.h"
+#include "audio/dsp.h"
+#include "audio/types.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Polyphase windowed-sinc resampler. For a rate ratio L/M in lowest terms
+// output frame n sits at input position n * M / L, and its phase (n * M) % L
+// selects one of L precomputed filters. Ratios with very large L, which only
+// odd rates produce, share MAX_PHASES filters at the nearest phase.
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TAPS 32
+#define MAX_PHASES 1024
+// Passband edge as a fraction of the lower Nyquist frequency
+#define ROLLOFF 0.94
+
+static float *filters = NULL;
+static int filters_rate = 0;
+static int num_phases = 0;
+static ResampleStats stats = {0};
+
+static long gcd(long a, long b) {
+  while (b) {
+    long t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static double blackman(double x) {
+  return 0.42 - 0.5 * cos(2.0 * M_PI * x) + 0.08 * cos(4.0 * M_PI * x);
+}
+
+static int build_filters(int samplerate) {
+  if (filters && filters_rate == samplerate)
+    return 0;
+  long g = gcd(ENGINE_SAMPLE_RATE, samplerate);
+  long up = ENGINE_SAMPLE_RATE / g;
+  long down = samplerate / g;
+  int phases = up < MAX_PHASES ? (int)up : MAX_PHASES;
+  float *table = malloc((size_t)phases * TAPS * sizeof(float));
+  if (!table)
+    return -1;
+  double cutoff = ROLLOFF * (up < down ? (double)up / down : 1.0);
+  for (int p = 0; p < phases; p++) {
+    float *h = table + (size_t)p * TAPS;
+    double frac = (double)p / phases;
+    double sum = 0.0;
+    for (int k = 0; k < TAPS; k++) {
+      // Distance from the output position to input tap k
+      double x = k - (TAPS / 2 - 1) - frac;
+      double t = M_PI * cutoff * x;
+      double sinc = fabs(t) < 1e-9 ? 1.0 : sin(t) / t;
+      h[k] = (float)(cutoff * sinc * blackman((x + TAPS / 2) / TAPS));
+      sum += h[k];
+    }
+    // Unity gain at DC for every phase
+    for (int k = 0; k < TAPS; k++)
+      h[k] = (float)(h[k] / sum);
+  }
+  free(filters);
+  filters = table;
+  filters_rate = samplerate;
+  num_phases = phases;
+  return 0;
+}
+
+int resample_needed(int channels, int samplerate) {
+  return samplerate != ENGINE_SAMPLE_RATE || channels > ENGINE_CHANNELS;
+}
+
+int resample_channels(int channels) {
+  return channels == 1 ? 1 : ENGINE_CHANNELS;
+}
+
+long resample_frames(long frames, int samplerate) {
+  long g = gcd(ENGINE_SAMPLE_RATE, samplerate);
+  long long up = ENGINE_SAMPLE_RATE / g;
+  long long down = samplerate / g;
+  return (long)(((long long)frames * up + down - 1) / down);
+}
+
+// Map the source to planar float output channels with TAPS / 2 frames of
+// silence either side, so every filter window stays inside the buffer.
+// Channels past the first two are spread evenly over left and right.
+static float *to_planar(const short *src, long frames, int channels,
+                        int out_channels) {
+  long stride = frames + TAPS;
+  float *planes = calloc((size_t)stride * out_channels, sizeof(float));
+  if (!planes)
+    return NULL;
+  int extra = channels > 2 ? channels - 2 : 0;
+  float scale = 1.0f / (1.0f + 0.5f * extra);
+  for (long i = 0; i < frames; i++) {
+    const short *frame = src + i * channels;
+    if (out_channels == 1) {
+      planes[TAPS / 2 + i] = frame[0];
+      continue;
+    }
+    float shared = 0.0f;
+    for (int c = 2; c < channels; c++)
+      shared += 0.5f * frame[c];
+    float left = frame[0] + shared;
+    float right = (channels > 1 ? frame[1] : frame[0]) + shared;
+    planes[TAPS / 2 + i] = left * scale;
+    planes[stride + TAPS / 2 + i] = right * scale;
+  }
+  return planes;
+}
+
+static double elapsed_ms(const struct timespec *start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1e3 +
+         (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+int resample_to_engine(short *dst, const short *src, long frames, int channels,
+                       int samplerate) {
+  if (frames <= 0 || channels <= 0 || samplerate <= 0)
+    return -1;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int out_channels = resample_channels(channels);
+  long out_frames = resample_frames(frames, samplerate);
+  if (build_filters(samplerate) != 0)
+    return -1;
+  float *planes = to_planar(src, frames, channels, out_channels);
+  float *mixed = malloc((size_t)out_frames * out_channels * sizeof(float));
+  if (!planes || !mixed) {
+    free(planes);
+    free(mixed);
+    return -1;
+  }
+  long g = gcd(ENGINE_SAMPLE_RATE, samplerate);
+  long long up = ENGINE_SAMPLE_RATE / g;
+  long long down = samplerate / g;
+  long stride = frames + TAPS;
+  for (long n = 0; n < out_frames; n++) {
+    long long position = (long long)n * down;
+    long base = (long)(position / up);
+    int phase = (int)((position % up) * num_phases / up);
+    const float *h = filters + (size_t)phase * TAPS;
+    // Tap 0 reads source frame base - (TAPS / 2 - 1), padded index base + 1
+    for (int c = 0; c < out_channels; c++)
+      mixed[n * out_channels + c] =
+          g_dsp.dot(h, planes + c * stride + base + 1, TAPS);
+  }
+  g_dsp.to_s16(dst, mixed, (int)(out_frames * out_channels));
+  free(planes);
+  free(mixed);
+  stats.clips++;
+  stats.milliseconds += elapsed_ms(&start);
+  stats.bytes_in += frames * channels * (long)sizeof(short);
+  stats.bytes_out += out_frames * out_channels * (long)sizeof(short);
+  return 0;
+}
+
+void resample_get_stats(ResampleStats *out) { *out = stats; }
@@ -0,0 +1,162 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio/sample_cache.h"
+#include "audio/log.h"
+#include "audio/playback.h"
+#include "audio/settings.h"
+#include "common/utils.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+  AudioClip clip; // first, so the release hook can get back to the entry
+  char *path;
+  uint64_t hash;
+  size_t bytes;
+  unsigned long last_used; // tick of the last lookup, for LRU eviction
+  int refs;
+  int evicted; // out of the table, freed when the last reference goes
+} CacheEntry;
+
+static CacheEntry **entries = NULL;
+static int num_entries = 0;
+static int capacity = 0;
+static unsigned long tick = 0;
+static size_t used = 0;
+static SampleCacheStats stats = {0};
+
+size_t sample_cache_budget(void) {
+  return (size_t)g_audio_settings.sample_cache_mb * 1024 * 1024;
+}
+
+static void free_entry(CacheEntry *e) {
+  free(e->clip.pcm);
+  free(e->path);
+  free(e);
+}
+
+static void release_entry(AudioClip *clip) {
+  CacheEntry *e = (CacheEntry *)clip;
+  if (--e->refs == 0 && e->evicted)
+    free_entry(e);
+}
+
+static void remove_entry(int index) {
+  CacheEntry *e = entries[index];
+  entries[index] = entries[--num_entries];
+  used -= e->bytes;
+  if (e->refs > 0)
+    e->evicted = 1;
+  else
+    free_entry(e);
+}
+
+// Make room for `bytes` more, oldest first. Playing entries are evicted too
+// and linger until their voices end, so the budget can be exceeded by at
+// most the clips of the voices playing.
+static void evict_for(size_t bytes) {
+  size_t budget = sample_cache_budget();
+  while (num_entries > 0 && used + bytes > budget) {
+    int oldest = 0;
+    for (int i = 1; i < num_entries; i++) {
+      if (entries[i]->last_used < entries[oldest]->last_used)
+        oldest = i;
+    }
+    VBX_LOG("Sample cache: evicting %s", entries[oldest]->path);
+    remove_entry(oldest);
+    stats.evictions++;
+  }
+}
+
+static CacheEntry *find_entry(const char *path, uint64_t hash) {
+  for (int i = 0; i < num_entries; i++) {
+    if (entries[i]->hash == hash && strcmp(entries[i]->path, path) == 0)
+      return entries[i];
+  }
+  return NULL;
+}
+
+// Decode `path` into a new entry. A file that fails to decode is kept as an
+// empty entry so it is not retried on every press.
+static CacheEntry *insert_entry(const char *path, uint64_t hash) {
+  if (num_entries == capacity) {
+    int grown_capacity = capacity ? capacity * 2 : 64;
+    CacheEntry **grown =
+        realloc(entries, grown_capacity * sizeof(*entries));
+    if (!grown)
+      return NULL;
+    entries = grown;
+    capacity = grown_capacity;
+  }
+  CacheEntry *e = calloc(1, sizeof(*e));
+  if (!e || !(e->path = xstrdup(path))) {
+    free(e);
+    return NULL;
+  }
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  AudioClip *decoded = decode_clip_file(path);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  stats.decode_ms += (end.tv_sec - start.tv_sec) * 1e3 +
+                     (end.tv_nsec - start.tv_nsec) / 1e6;
+  if (decoded) {
+    e->clip = *decoded;
+    free(decoded);
+  }
+  e->clip.release = release_entry;
+  e->hash = hash;
+  e->bytes = (size_t)e->clip.frames * e->clip.channels * sizeof(short);
+  evict_for(e->bytes);
+  entries[num_entries++] = e;
+  used += e->bytes;
+  return e;
+}
+
+AudioClip *sample_cache_get(const char *path) {
+  uint64_t hash = fnv1a(FNV1A_OFFSET, path, strlen(path));
+  CacheEntry *e = find_entry(path, hash);
+  if (e) {
+    stats.hits++;
+  } else {
+    stats.misses++;
+    e = insert_entry(path, hash);
+    if (!e)
+      return NULL;
+  }
+  e->last_used = ++tick;
+  if (e->clip.frames <= 0)
+    return NULL;
+  e->refs++;
+  return &e->clip;
+}
+
+int sample_cache_prefetch(const char *path) {
+  uint64_t hash = fnv1a(FNV1A_OFFSET, path, strlen(path));
+  if (find_entry(path, hash))
+    return 0;
+  if (used >= sample_cache_budget())
+    return -1;
+  CacheEntry *e = insert_entry(path, hash);
+  if (!e)
+    return -1;
+  e->last_used = ++tick;
+  return 0;
+}
+
+void sample_cache_get_stats(SampleCacheStats *out) {
+  *out = stats;
+  out->entries = (unsigned int)num_entries;
+  out->bytes = used;
+  out->budget = sample_cache_budget();
+}
+
+void sample_cache_clear(void) {
+  while (num_entries > 0)
+    remove_entry(num_entries - 1);
+  free(entries);
+  entries = NULL;
+  capacity = 0;
+  used = 0;
+}
@@ -0,0 +1,186 @@
+#include "audio/settings.h"
+#include "audio/types.h"
+#include "common/realtime.h"
+#include "common/utils.h"
+#include <json-c/json.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+AudioSettings g_audio_settings = {
+    .polyphony = DEFAULT_POLYPHONY,
+    .steal_policy = STEAL_OLDEST,
+    .retrigger = RETRIGGER_CROSSFADE,
+    .retrigger_fade_ms = 8.0,
+    .release_fade_ms = 0.0,
+    .backend = "pulse",
+    .cache = 1,
+    .sample_cache_mb = 64,
+    .variation = VARIATION_RANDOM,
+    .pulse = {.tlength_ms = 10.0,
+              .minreq_ms = 2.5,
+              .prebuf_ms = -1.0,
+              .adjust_latency = 1,
+              .early_requests = 0},
+    .alsa = {.device = "default", .period_frames = 128, .periods = 2},
+    .pipewire = {.quantum = 128},
+    .realtime = {.enabled = 0,
+                 .priority = REALTIME_DEFAULT_PRIORITY,
+                 .lock_memory = 1,
+                 .mixer_cpu = -1,
+                 .input_cpu = -1},
+    .trim = {.enabled = 1, .threshold_db = -60.0, .fade_ms = 2.0},
+    .log = {.history = 0},
+};
+
+static void read_double(json_object *parent, const char *key, double *out) {
+  json_object *o;
+  if (json_object_object_get_ex(parent, key, &o))
+    *out = json_object_get_double(o);
+}
+
+static double clamp_double(double value, double min, double max) {
+  return value < min ? min : value > max ? max : value;
+}
+
+static void read_string(json_object *parent, const char *key, char *out,
+                        size_t size) {
+  json_object *o;
+  if (json_object_object_get_ex(parent, key, &o)) {
+    const char *value = json_object_get_string(o);
+    if (value)
+      safe_snprintf(out, size, "%s", value);
+  }
+}
+
+static void read_int(json_object *parent, const char *key, int *out, int min,
+                     int max) {
+  json_object *o;
+  if (json_object_object_get_ex(parent, key, &o)) {
+    int value = json_object_get_int(o);
+    *out = value < min ? min : value > max ? max : value;
+  }
+}
+
+static void read_bool(json_object *parent, const char *key, int *out) {
+  json_object *o;
+  if (json_object_object_get_ex(parent, key, &o))
+    *out = json_object_get_boolean(o);
+}
+
+int load_audio_settings(void) {
+  safe_snprintf(g_audio_settings.wav_path, sizeof(g_audio_settings.wav_path),
+                "%s/vbx-output-%d.wav", get_runtime_dir(), (int)getuid());
+  const char *home = get_home_dir();
+  char path[1024];
+  if (!home || !safe_snprintf(path, sizeof(path), "%s/.vbx.json", home))
+    return 0;
+  if (access(path, R_OK) != 0)
+    return 0;
+  json_object *root = json_object_from_file(path);
+  if (!root) {
+    safe_fprintf(stderr,
+                 "Warning: Could not parse %s, using default audio settings\n",
+                 path);
+    return -1;
+  }
+  json_object *audio, *o;
+  if (!json_object_object_get_ex(root, "audio", &audio)) {
+    json_object_put(root);
+    return 0;
+  }
+  read_int(audio, "polyphony", &g_audio_settings.polyphony, 1, MAX_POLYPHONY);
+  if (json_object_object_get_ex(audio, "voice_steal", &o)) {
+    const char *policy = json_object_get_string(o);
+    if (policy && strcmp(policy, "quietest") == 0)
+      g_audio_settings.steal_policy = STEAL_QUIETEST;
+    else if (policy && strcmp(policy, "oldest") == 0)
+      g_audio_settings.steal_policy = STEAL_OLDEST;
+    else
+      safe_fprintf(stderr, "Warning: Unknown voice_steal policy '%s'\n",
+                   policy ? policy : "");
+  }
+  if (json_object_object_get_ex(audio, "retrigger", &o)) {
+    const char *policy = json_object_get_string(o);
+    if (policy && strcmp(policy, "stack") == 0)
+      g_audio_settings.retrigger = RETRIGGER_STACK;
+    else if (policy && strcmp(policy, "cut") == 0)
+      g_audio_settings.retrigger = RETRIGGER_CUT;
+    else if (policy && strcmp(policy, "crossfade") == 0)
+      g_audio_settings.retrigger = RETRIGGER_CROSSFADE;
+    else
+      safe_fprintf(stderr, "Warning: Unknown retrigger policy '%s'\n",
+                   policy ? policy : "");
+  }
+  read_double(audio, "retrigger_fade_ms", &g_audio_settings.retrigger_fade_ms);
+  g_audio_settings.retrigger_fade_ms =
+      clamp_double(g_audio_settings.retrigger_fade_ms, 1.0, 100.0);
+  read_double(audio, "release_fade_ms", &g_audio_settings.release_fade_ms);
+  g_audio_settings.release_fade_ms =
+      clamp_double(g_audio_settings.release_fade_ms, 0.0, 500.0);
+  if (json_object_object_get_ex(audio, "variation", &o)) {
+    const char *policy = json_object_get_string(o);
+    if (policy && strcmp(policy, "random") == 0)
+      g_audio_settings.variation = VARIATION_RANDOM;
+    else if (policy && strcmp(policy, "round_robin") == 0)
+      g_audio_settings.variation = VARIATION_ROUND_ROBIN;
+    else
+      safe_fprintf(stderr, "Warning: Unknown variation policy '%s'\n",
+                   policy ? policy : "");
+  }
+  if (json_object_object_get_ex(audio, "variation_seed", &o))
+    g_audio_settings.variation_seed = (unsigned int)json_object_get_int64(o);
+  read_string(audio, "backend", g_audio_settings.backend,
+              sizeof(g_audio_settings.backend));
+  read_bool(audio, "cache", &g_audio_settings.cache);
+  read_int(audio, "sample_cache_mb", &g_audio_settings.sample_cache_mb, 0,
+           4096);
+  read_string(audio, "wav_path", g_audio_settings.wav_path,
+              sizeof(g_audio_settings.wav_path));
+  json_object *pulse;
+  if (json_object_object_get_ex(audio, "pulse", &pulse)) {
+    PulseSettings *ps = &g_audio_settings.pulse;
+    read_double(pulse, "tlength_ms", &ps->tlength_ms);
+    read_double(pulse, "minreq_ms", &ps->minreq_ms);
+    read_double(pulse, "prebuf_ms", &ps->prebuf_ms);
+    read_bool(pulse, "adjust_latency", &ps->adjust_latency);
+    read_bool(pulse, "early_requests", &ps->early_requests);
+  }
+  json_object *alsa;
+  if (json_object_object_get_ex(audio, "alsa", &alsa)) {
+    AlsaSettings *as = &g_audio_settings.alsa;
+    read_string(alsa, "device", as->device, sizeof(as->device));
+    read_int(alsa, "period_frames", &as->period_frames, 16, 4096);
+    read_int(alsa, "periods", &as->periods, 2, 16);
+  }
+  json_object *pipewire;
+  if (json_object_object_get_ex(audio, "pipewire", &pipewire))
+    read_int(pipewire, "quantum", &g_audio_settings.pipewire.quantum, 16, 8192);
+  json_object *realtime;
+  if (json_object_object_get_ex(audio, "realtime", &realtime)) {
+    RealtimeSettings *rs = &g_audio_settings.realtime;
+    read_bool(realtime, "enabled", &rs->enabled);
+    read_int(realtime, "priority", &rs->priority, REALTIME_MIN_PRIORITY,
+             REALTIME_MAX_PRIORITY);
+    read_bool(realtime, "lock_memory", &rs->lock_memory);
+    read_int(realtime, "mixer_cpu", &rs->mixer_cpu, -1, REALTIME_MAX_CPU);
+    read_int(realtime, "input_cpu", &rs->input_cpu, -1, REALTIME_MAX_CPU);
+  }
+  json_object *trim;
+  if (json_object_object_get_ex(audio, "trim", &trim)) {
+    TrimSettings *ts = &g_audio_settings.trim;
+    read_bool(trim, "enabled", &ts->enabled);
+    read_double(trim, "threshold_db", &ts->threshold_db);
+    read_double(trim, "fade_ms", &ts->fade_ms);
+    ts->threshold_db = clamp_double(ts->threshold_db, -96.0, -20.0);
+    ts->fade_ms = clamp_double(ts->fade_ms, 0.0, 50.0);
+  }
+  json_object *log;
+  if (json_object_object_get_ex(audio, "log", &log)) {
+    LogSettings *ls = &g_audio_settings.log;
+    read_int(log, "history", &ls->history, 0, 65536);
+    read_string(log, "file", ls->file, sizeof(ls->file));
+  }
+  json_object_put(root);
+  return 0;
+}
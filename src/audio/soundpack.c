@@ -0,0 +1,185 @@
+#include "audio/soundpack.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static void init_pack(SoundPack *pack) {
+  memset(pack, 0, sizeof(*pack));
+  pack->generic_press = NO_SOUND;
+  pack->release = NO_SOUND;
+  pack->sound_file = -1;
+  for (int key = 0; key < SOUND_PACK_KEYS; key++)
+    pack->last_variant[key][0] = pack->last_variant[key][1] = -1;
+}
+
+SoundPack *sound_pack_new(void) {
+  SoundPack *pack = malloc(sizeof(*pack));
+  if (pack)
+    init_pack(pack);
+  return pack;
+}
+
+void sound_pack_clear(SoundPack *pack) {
+  free(pack->keys);
+  free(pack->sounds);
+  free(pack->banks);
+  free(pack->variants);
+  free(pack->strings);
+  free(pack->samples);
+  free(pack->variant_samples);
+  if (pack->mapping)
+    munmap(pack->mapping, pack->mapping_size);
+  init_pack(pack);
+}
+
+void sound_pack_free(SoundPack *pack) {
+  if (!pack)
+    return;
+  sound_pack_clear(pack);
+  free(pack);
+}
+
+// Double `*array` until it holds `needed` elements
+static int reserve(void **array, int *capacity, int needed, size_t element) {
+  if (needed <= *capacity)
+    return 0;
+  int grown_capacity = *capacity ? *capacity * 2 : 32;
+  while (grown_capacity < needed)
+    grown_capacity *= 2;
+  void *grown = realloc(*array, grown_capacity * element);
+  if (!grown)
+    return -1;
+  *array = grown;
+  *capacity = grown_capacity;
+  return 0;
+}
+
+int sound_pack_intern(SoundPack *pack, const char *s) {
+  size_t offset = 0;
+  while (offset < pack->strings_used) {
+    if (strcmp(pack->strings + offset, s) == 0)
+      return (int)offset;
+    offset += strlen(pack->strings + offset) + 1;
+  }
+  size_t len = strlen(s) + 1;
+  if (pack->strings_used + len > pack->strings_capacity) {
+    size_t capacity = pack->strings_capacity ? pack->strings_capacity : 1024;
+    while (capacity < pack->strings_used + len)
+      capacity *= 2;
+    char *grown = realloc(pack->strings, capacity);
+    if (!grown)
+      return -1;
+    pack->strings = grown;
+    pack->strings_capacity = capacity;
+  }
+  memcpy(pack->strings + pack->strings_used, s, len);
+  pack->strings_used += len;
+  return (int)offset;
+}
+
+const char *sound_pack_string(const SoundPack *pack, int offset) {
+  return offset < 0 ? NULL : pack->strings + offset;
+}
+
+static int add_sound(SoundPack *pack, const PackSound *sound) {
+  if (reserve((void **)&pack->sounds, &pack->sounds_capacity,
+              pack->num_sounds + 1, sizeof(*pack->sounds)) != 0)
+    return NO_SOUND;
+  pack->sounds[pack->num_sounds] = *sound;
+  return pack->num_sounds++;
+}
+
+int sound_pack_add_file(SoundPack *pack, const char *path) {
+  int offset = sound_pack_intern(pack, path);
+  if (offset < 0)
+    return NO_SOUND;
+  // Interned, so the same path has the same offset
+  for (int i = 0; i < pack->num_sounds; i++) {
+    if (pack->sounds[i].path == offset)
+      return i;
+  }
+  PackSound sound = {.path = offset};
+  return add_sound(pack, &sound);
+}
+
+int sound_pack_add_range(SoundPack *pack, int start_ms, int duration_ms) {
+  for (int i = 0; i < pack->num_sounds; i++) {
+    if (pack->sounds[i].start_ms == start_ms &&
+        pack->sounds[i].duration_ms == duration_ms)
+      return i;
+  }
+  PackSound sound = {.path = -1, .start_ms = start_ms,
+                     .duration_ms = duration_ms};
+  return add_sound(pack, &sound);
+}
+
+int sound_pack_add_clip(SoundPack *pack, const AudioClip *clip) {
+  PackSound sound = {.path = -1, .clip = *clip};
+  return add_sound(pack, &sound);
+}
+
+int sound_pack_add_bank(SoundPack *pack, const int *sounds, int count) {
+  for (int i = 0; i < pack->num_banks; i++) {
+    const PackBank *b = &pack->banks[i];
+    if (b->count == count &&
+        memcmp(&pack->variants[b->first], sounds, count * sizeof(int)) == 0)
+      return i;
+  }
+  if (reserve((void **)&pack->variants, &pack->variants_capacity,
+              pack->num_variants + count, sizeof(*pack->variants)) != 0 ||
+      reserve((void **)&pack->banks, &pack->banks_capacity,
+              pack->num_banks + 1, sizeof(*pack->banks)) != 0)
+    return NO_SOUND;
+  memcpy(&pack->variants[pack->num_variants], sounds, count * sizeof(int));
+  PackBank *b = &pack->banks[pack->num_banks];
+  b->first = pack->num_variants;
+  b->count = count;
+  pack->num_variants += count;
+  return pack->num_banks++;
+}
+
+// Position of `code` in the key table, or where it would be inserted
+static int key_position(const SoundPack *pack, int code) {
+  int lo = 0, hi = pack->num_keys;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (pack->keys[mid].code < code)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+int sound_pack_set_key(SoundPack *pack, int code, int is_release, int bank) {
+  if (code < 0 || code >= SOUND_PACK_KEYS)
+    return -1;
+  int pos = key_position(pack, code);
+  if (pos == pack->num_keys || pack->keys[pos].code != code) {
+    if (reserve((void **)&pack->keys, &pack->keys_capacity,
+                pack->num_keys + 1, sizeof(*pack->keys)) != 0)
+      return -1;
+    memmove(&pack->keys[pos + 1], &pack->keys[pos],
+            (pack->num_keys - pos) * sizeof(*pack->keys));
+    pack->keys[pos].code = (unsigned short)code;
+    pack->keys[pos].press = NO_SOUND;
+    pack->keys[pos].release = NO_SOUND;
+    pack->num_keys++;
+  }
+  if (is_release)
+    pack->keys[pos].release = (short)bank;
+  else
+    pack->keys[pos].press = (short)bank;
+  return 0;
+}
+
+const PackKey *sound_pack_find_key(const SoundPack *pack, int code) {
+  int pos = key_position(pack, code);
+  if (pos < pack->num_keys && pack->keys[pos].code == code)
+    return &pack->keys[pos];
+  return NULL;
+}
+
+const char *sound_pack_path(const SoundPack *pack, int sound) {
+  return sound_pack_string(pack, pack->sounds[sound].path);
+}
@@ -0,0 +1,130 @@
+#include "audio/stats.h"
+#include "audio/latency.h"
+#include "audio/mixer.h"
+#include "audio/pack.h"
+#include "audio/playback.h"
+#include "audio/sample_cache.h"
+#include "audio/settings.h"
+#include "common/utils.h"
+#include <json-c/json.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static json_object *latency_object(void) {
+  json_object *stages = json_object_new_object();
+  for (int s = 0; s < NUM_LATENCY_STAGES; s++) {
+    LatencySummary sum;
+    latency_get_summary((LatencyStage)s, &sum);
+    json_object *stage = json_object_new_object();
+    json_object_object_add(stage, "count", json_object_new_int64(sum.count));
+    json_object_object_add(stage, "mean", json_object_new_double(sum.mean_us));
+    json_object_object_add(stage, "p50", json_object_new_int64(sum.p50_us));
+    json_object_object_add(stage, "p90", json_object_new_int64(sum.p90_us));
+    json_object_object_add(stage, "p99", json_object_new_int64(sum.p99_us));
+    json_object_object_add(stage, "max", json_object_new_int64(sum.max_us));
+    json_object_object_add(stages, latency_stage_name((LatencyStage)s), stage);
+  }
+  return stages;
+}
+
+static json_object *stats_object(time_t started) {
+  time_t now = time(NULL);
+  MixerStats mixer;
+  EventQueueStats queue;
+  SampleCacheStats cache;
+  PackLoadStats packs;
+  mixer_get_stats(&mixer);
+  get_event_queue_stats(&queue);
+  sample_cache_get_stats(&cache);
+  pack_get_load_stats(&packs);
+
+  json_object *root = json_object_new_object();
+  json_object_object_add(root, "pid", json_object_new_int((int)getpid()));
+  json_object_object_add(root, "updated", json_object_new_int64(now));
+  json_object_object_add(root, "uptime",
+                         json_object_new_int64(now - started));
+  json_object_object_add(root, "backend",
+                         json_object_new_string(mixer_backend_name()));
+  json_object_object_add(root, "output_latency_us",
+                         json_object_new_int64(mixer_output_latency_us()));
+
+  json_object *events = json_object_new_object();
+  json_object_object_add(events, "received",
+                         json_object_new_int64(queue.received));
+  // Lost in either queue: the stdin reader's or the mixer's
+  json_object_object_add(
+      events, "dropped",
+      json_object_new_int64(queue.dropped + mixer.events_dropped));
+  json_object_object_add(events, "queue_high_water",
+                         json_object_new_int(queue.high_water));
+  json_object_object_add(events, "queue_capacity",
+                         json_object_new_int(queue.capacity));
+  json_object_object_add(root, "events", events);
+
+  json_object *voices = json_object_new_object();
+  json_object_object_add(voices, "active",
+                         json_object_new_int(mixer.active_voices));
+  json_object_object_add(voices, "peak",
+                         json_object_new_int64(mixer.peak_voices));
+  json_object_object_add(voices, "polyphony",
+                         json_object_new_int(g_audio_settings.polyphony));
+  json_object_object_add(voices, "started",
+                         json_object_new_int64(mixer.voices_started));
+  json_object_object_add(voices, "stolen",
+                         json_object_new_int64(mixer.voices_stolen));
+  json_object_object_add(voices, "retriggered",
+                         json_object_new_int64(mixer.voices_retriggered));
+  json_object_object_add(root, "voices", voices);
+
+  json_object *sc = json_object_new_object();
+  json_object_object_add(sc, "bytes", json_object_new_int64(cache.bytes));
+  json_object_object_add(sc, "budget", json_object_new_int64(cache.budget));
+  json_object_object_add(sc, "entries", json_object_new_int(cache.entries));
+  json_object_object_add(sc, "hits", json_object_new_int64(cache.hits));
+  json_object_object_add(sc, "misses", json_object_new_int64(cache.misses));
+  json_object_object_add(sc, "evictions",
+                         json_object_new_int64(cache.evictions));
+  json_object_object_add(sc, "decode_ms",
+                         json_object_new_double(cache.decode_ms));
+  json_object_object_add(root, "sample_cache", sc);
+
+  json_object *pk = json_object_new_object();
+  json_object_object_add(pk, "mapped", json_object_new_int(packs.mapped));
+  json_object_object_add(pk, "decoded", json_object_new_int(packs.decoded));
+  json_object_object_add(pk, "load_ms", json_object_new_double(packs.load_ms));
+  json_object_object_add(root, "packs", pk);
+
+  json_object_object_add(root, "underruns",
+                         json_object_new_int64(mixer.underruns));
+  json_object_object_add(root, "latency_us", latency_object());
+  return root;
+}
+
+int write_engine_stats(time_t started) {
+  char path[1024], tmp_path[1100];
+  build_stats_path(path, sizeof(path));
+  if (!safe_snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path))
+    return -1;
+  json_object *root = stats_object(started);
+  FILE *f = fopen(tmp_path, "w");
+  if (!f) {
+    json_object_put(root);
+    return -1;
+  }
+  // Renamed into place, so `vbx --stats` never reads half a file
+  fputs(json_object_to_json_string_ext(root, JSON_C_TO_STRING_PLAIN), f);
+  fputc('\n', f);
+  json_object_put(root);
+  if (fclose(f) != 0 || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+void remove_engine_stats(void) {
+  char path[1024];
+  build_stats_path(path, sizeof(path));
+  unlink(path);
+}
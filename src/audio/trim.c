@@ -0,0 +1,69 @@
+#include "audio/trim.h"
+#include "audio/settings.h"
+#include <math.h>
+#include <string.h>
+
+static TrimStats stats = {0};
+
+static int frame_peak(const short *frame, int channels) {
+  int peak = 0;
+  for (int c = 0; c < channels; c++) {
+    int s = frame[c] < 0 ? -frame[c] : frame[c];
+    if (s > peak)
+      peak = s;
+  }
+  return peak;
+}
+
+// Linear ramp over `frames` frames, rising for a fade-in. The ramp never
+// reaches 0 or 1, which the neighbouring samples already are.
+static void fade(short *pcm, long frames, int channels, int fade_in) {
+  for (long i = 0; i < frames; i++) {
+    float gain = fade_in ? (float)(i + 1) / (frames + 1)
+                         : (float)(frames - i) / (frames + 1);
+    for (int c = 0; c < channels; c++)
+      pcm[i * channels + c] = (short)lrintf(pcm[i * channels + c] * gain);
+  }
+}
+
+void trim_clip(AudioClip *clip) {
+  const TrimSettings *ts = &g_audio_settings.trim;
+  if (!ts->enabled || !clip->pcm || clip->frames <= 0 ||
+      clip->samplerate <= 0)
+    return;
+  int channels = clip->channels;
+  double ms_per_frame = 1000.0 / clip->samplerate;
+  int threshold = (int)lround(32768.0 * pow(10.0, ts->threshold_db / 20.0));
+  if (threshold < 1)
+    threshold = 1;
+  stats.clips++;
+  stats.total_ms += clip->frames * ms_per_frame;
+  long first = 0;
+  while (first < clip->frames &&
+         frame_peak(clip->pcm + first * channels, channels) < threshold)
+    first++;
+  if (first == clip->frames)
+    return;
+  long last = clip->frames - 1;
+  while (frame_peak(clip->pcm + last * channels, channels) < threshold)
+    last--;
+  // The margin keeps the onset intact: fading it would soften the click
+  long margin = (long)(ts->fade_ms * clip->samplerate / 1000.0);
+  long start = first > margin ? first - margin : 0;
+  long end = clip->frames - last - 1 > margin ? last + 1 + margin
+                                               : clip->frames;
+  if (start == 0 && end == clip->frames)
+    return;
+  if (start > 0)
+    fade(clip->pcm + start * channels, first - start, channels, 1);
+  if (end < clip->frames)
+    fade(clip->pcm + (last + 1) * channels, end - last - 1, channels, 0);
+  memmove(clip->pcm, clip->pcm + start * channels,
+          (size_t)(end - start) * channels * sizeof(short));
+  stats.trimmed++;
+  stats.lead_ms += start * ms_per_frame;
+  stats.tail_ms += (clip->frames - end) * ms_per_frame;
+  clip->frames = end - start;
+}
+
+void trim_get_stats(TrimStats *out) { *out = stats; }
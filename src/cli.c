@@ -41,12 +41,14 @@ void print_usage(const char *program_name) {
          "reload.\n\n");
 
   printf("USAGE:\n");
-  printf("  %s [OPTIONS]\n\n", program_name);
+  printf("  %s [OPTIONS]\n", program_name);
+  printf("  %s pack build PACK [-o FILE] [-v]\n\n", program_name);
 
   printf("SOUND PACKS:\n");
   printf("  -S, --sound PACK         Choose keyboard sound pack\n");
   printf("  -M, --mouse PACK         Choose mouse sound pack\n");
-  printf("  -l, --list               Show available sound packs\n\n");
+  printf("  -l, --list               Show available sound packs\n");
+  printf("  pack build PACK          Compile a pack into one .vbxpack file\n\n");
 
   printf("VOLUME CONTROL:\n");
   printf("  -V, --volume LEVEL       Set volume for both devices [0-100]\n");
@@ -63,7 +65,8 @@ void print_usage(const char *program_name) {
 
   printf("DAEMON MODE:\n");
   printf("  -d, --daemon             Run in background with auto-reload\n");
-  printf("  -s, --stop               Stop background daemon\n\n");
+  printf("  -s, --stop               Stop background daemon\n");
+  printf("  --stats [--json]         Show live engine counters\n\n");
 
   printf("OTHER OPTIONS:\n");
   printf("  -v, --verbose            Show detailed output\n");
@@ -86,6 +89,9 @@ void print_usage(const char *program_name) {
       program_name);
   printf("  %s --keyboard-volume 80 --mouse-volume 60    # Different volumes\n",
          program_name);
+  printf("  %s --stats --json                            # Engine counters "
+         "for scripts\n",
+         program_name);
   printf("\n");
   printf("CONFIGURATION:\n");
   printf(
@@ -112,6 +118,8 @@ int parse_cli(int argc, char **argv, CliOptions *out) {
       {"unmute", optional_argument, 0, 'u'},
       {"enable", optional_argument, 0, 1000},
       {"disable", optional_argument, 0, 1001},
+      {"stats", no_argument, 0, 1002},
+      {"json", no_argument, 0, 1003},
       {"list", no_argument, 0, 'l'},
       {"daemon", no_argument, 0, 'd'},
       {"stop", no_argument, 0, 's'},
@@ -133,6 +141,8 @@ int parse_cli(int argc, char **argv, CliOptions *out) {
             (n == 6 && strncmp(a, "unmute", 6) == 0) ||
             (n == 6 && strncmp(a, "enable", 6) == 0) ||
             (n == 7 && strncmp(a, "disable", 7) == 0) ||
+            (n == 5 && strncmp(a, "stats", 5) == 0) ||
+            (n == 4 && strncmp(a, "json", 4) == 0) ||
             (n == 4 && strncmp(a, "help", 4) == 0) ||
             (n == 7 && strncmp(a, "verbose", 7) == 0))) {
         safe_fprintf(stderr, "Error: Unknown option '%s'\n", argv[i]);
@@ -199,6 +209,12 @@ int parse_cli(int argc, char **argv, CliOptions *out) {
         return 1;
       }
     } break;
+    case 1002: // --stats
+      out->stats_flag = 1;
+      break;
+    case 1003: // --json
+      out->json_flag = 1;
+      break;
     case 'l':
       out->list_flag = 1;
       break;
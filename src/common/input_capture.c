@@ -0,0 +1,169 @@
+#define _POSIX_C_SOURCE 200809L
+#include "common/input_capture.h"
+#include "common/utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libinput.h>
+#include <libudev.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct InputCapture {
+  struct udev *udev;
+  struct libinput *libinput;
+  EventRecord batch[INPUT_CAPTURE_BATCH];
+  int batch_count;
+  int stop_pipe[2]; // written by input_capture_stop() to end the run
+};
+
+static int open_restricted(const char *path, int flags, void *user_data) {
+  (void)user_data;
+  int fd = open(path, flags);
+  if (fd < 0)
+    errorf("Failed to open %s because of %s.\n", path, strerror(errno));
+  return fd < 0 ? -errno : fd;
+}
+
+static void close_restricted(int fd, void *user_data) {
+  (void)user_data;
+  close(fd);
+}
+
+static const struct libinput_interface interface = {
+    .open_restricted = open_restricted, .close_restricted = close_restricted};
+
+static void flush(InputCapture *c, InputSink sink, void *user) {
+  if (c->batch_count == 0)
+    return;
+  if (sink)
+    sink(c->batch, c->batch_count, user);
+  c->batch_count = 0;
+}
+
+static void add(InputCapture *c, EventDevice device, uint32_t code,
+                int pressed, uint64_t time_us, InputSink sink, void *user) {
+  if (c->batch_count == INPUT_CAPTURE_BATCH)
+    flush(c, sink, user);
+  EventRecord *r = &c->batch[c->batch_count++];
+  r->magic = EVENT_RECORD_MAGIC;
+  r->version = EVENT_RECORD_VERSION;
+  r->device = (uint8_t)device;
+  r->pressed = pressed ? 1 : 0;
+  r->code = code;
+  r->time_us = time_us;
+  r->sent_us = 0;
+}
+
+// Returns -1 if libinput had nothing at all to hand out
+static int dispatch(InputCapture *c, InputSink sink, void *user) {
+  int result = -1;
+  struct libinput_event *event;
+  if (libinput_dispatch(c->libinput) < 0)
+    return result;
+  while ((event = libinput_get_event(c->libinput)) != NULL) {
+    switch (libinput_event_get_type(event)) {
+    case LIBINPUT_EVENT_KEYBOARD_KEY: {
+      struct libinput_event_keyboard *k =
+          libinput_event_get_keyboard_event(event);
+      add(c, EVENT_DEVICE_KEYBOARD, libinput_event_keyboard_get_key(k),
+          libinput_event_keyboard_get_key_state(k) ==
+              LIBINPUT_KEY_STATE_PRESSED,
+          libinput_event_keyboard_get_time_usec(k), sink, user);
+      break;
+    }
+    case LIBINPUT_EVENT_POINTER_BUTTON: {
+      struct libinput_event_pointer *p =
+          libinput_event_get_pointer_event(event);
+      add(c, EVENT_DEVICE_POINTER, libinput_event_pointer_get_button(p),
+          libinput_event_pointer_get_button_state(p) ==
+              LIBINPUT_BUTTON_STATE_PRESSED,
+          libinput_event_pointer_get_time_usec(p), sink, user);
+      break;
+    }
+    default:
+      break;
+    }
+    libinput_event_destroy(event);
+    result = 0;
+  }
+  flush(c, sink, user);
+  return result;
+}
+
+InputCapture *input_capture_open(void) {
+  InputCapture *c = calloc(1, sizeof(*c));
+  if (!c) {
+    errorf("Error: Memory allocation failed\n");
+    return NULL;
+  }
+  if (pipe(c->stop_pipe) != 0) {
+    errorf("pipe failed: %s\n", strerror(errno));
+    free(c);
+    return NULL;
+  }
+  c->udev = udev_new();
+  if (!c->udev) {
+    errorf("Failed to initialize udev.\n");
+    input_capture_close(c);
+    return NULL;
+  }
+  c->libinput = libinput_udev_create_context(&interface, NULL, c->udev);
+  if (!c->libinput) {
+    errorf("Failed to initialize libinput from udev.\n");
+    input_capture_close(c);
+    return NULL;
+  }
+  if (libinput_udev_assign_seat(c->libinput, "seat0") != 0) {
+    errorf("Failed to set seat.\n");
+    input_capture_close(c);
+    return NULL;
+  }
+  // Only device-added events are pending yet, and they are not passed on
+  if (dispatch(c, NULL, NULL) != 0) {
+    errorf("Expected device added events on startup but got none. Maybe "
+           "you don't have the right permissions?\n");
+    input_capture_close(c);
+    return NULL;
+  }
+  return c;
+}
+
+int input_capture_run(InputCapture *c, InputSink sink, void *user) {
+  struct pollfd fds[2];
+  fds[0].fd = libinput_get_fd(c->libinput);
+  fds[0].events = POLLIN;
+  fds[1].fd = c->stop_pipe[0];
+  fds[1].events = POLLIN;
+  while (1) {
+    fds[0].revents = fds[1].revents = 0;
+    int pr = poll(fds, 2, -1);
+    if (pr < 0) {
+      if (errno == EINTR)
+        continue;
+      return errorf("poll failed: %s\n", strerror(errno));
+    }
+    if (fds[1].revents)
+      return 0;
+    dispatch(c, sink, user);
+  }
+}
+
+void input_capture_stop(InputCapture *c) {
+  char byte = 0;
+  while (write(c->stop_pipe[1], &byte, 1) < 0 && errno == EINTR)
+    ;
+}
+
+void input_capture_close(InputCapture *c) {
+  if (!c)
+    return;
+  close(c->stop_pipe[0]);
+  close(c->stop_pipe[1]);
+  if (c->libinput)
+    libinput_unref(c->libinput);
+  if (c->udev)
+    udev_unref(c->udev);
+  free(c);
+}
@@ -0,0 +1,108 @@
+#define _GNU_SOURCE
+#include "common/realtime.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef VBX_WITH_RTKIT
+#include <dbus/dbus.h>
+
+// rtkit only serves processes whose real-time CPU time is capped at or
+// below its own limit, 200 ms by default, so a runaway thread is killed
+// instead of locking up the machine
+#define RTKIT_RTTIME_US 200000
+
+static int rtkit_make_realtime(pid_t tid, int priority) {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_RTTIME, &rl) == 0 &&
+      (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > RTKIT_RTTIME_US)) {
+    rl.rlim_cur = rl.rlim_max = RTKIT_RTTIME_US;
+    if (setrlimit(RLIMIT_RTTIME, &rl) != 0)
+      return -1;
+  }
+  DBusError error;
+  dbus_error_init(&error);
+  DBusConnection *bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, &error);
+  if (!bus) {
+    dbus_error_free(&error);
+    return -1;
+  }
+  dbus_connection_set_exit_on_disconnect(bus, FALSE);
+  int rc = -1;
+  DBusMessage *call = dbus_message_new_method_call(
+      "org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+      "org.freedesktop.RealtimeKit1", "MakeThreadRealtime");
+  dbus_uint64_t thread = (dbus_uint64_t)tid;
+  dbus_uint32_t prio = (dbus_uint32_t)priority;
+  if (call && dbus_message_append_args(call, DBUS_TYPE_UINT64, &thread,
+                                       DBUS_TYPE_UINT32, &prio,
+                                       DBUS_TYPE_INVALID)) {
+    DBusMessage *reply =
+        dbus_connection_send_with_reply_and_block(bus, call, -1, &error);
+    if (reply) {
+      rc = 0;
+      dbus_message_unref(reply);
+    }
+  }
+  if (call)
+    dbus_message_unref(call);
+  dbus_error_free(&error);
+  dbus_connection_close(bus);
+  dbus_connection_unref(bus);
+  return rc;
+}
+#endif
+
+int realtime_promote_thread(int priority) {
+  struct sched_param param = {.sched_priority = priority};
+  int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (err == 0)
+    return 0;
+#ifdef VBX_WITH_RTKIT
+  if (err == EPERM &&
+      rtkit_make_realtime((pid_t)syscall(SYS_gettid), priority) == 0)
+    return 0;
+#endif
+  errno = err;
+  return -1;
+}
+
+int realtime_pin_thread(int cpu) {
+  if (cpu < 0)
+    return 0;
+  if (cpu >= CPU_SETSIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+int realtime_setup_thread(const char *name, int priority, int cpu) {
+  int rc = 0;
+  if (realtime_promote_thread(priority) != 0) {
+    fprintf(stderr,
+            "Warning: Could not make the %s thread real-time (%s); it keeps "
+            "normal scheduling\n",
+            name, strerror(errno));
+    rc = -1;
+  }
+  if (realtime_pin_thread(cpu) != 0) {
+    fprintf(stderr, "Warning: Could not pin the %s thread to CPU %d (%s)\n",
+            name, cpu, strerror(errno));
+    rc = -1;
+  }
+  return rc;
+}
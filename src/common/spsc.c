@@ -0,0 +1,52 @@
+#include "common/spsc.h"
+#include <stdlib.h>
+#include <string.h>
+
+int spsc_init(SpscRing *ring, size_t record_size, unsigned int capacity) {
+  unsigned int size = 1;
+  while (size < capacity)
+    size <<= 1;
+  memset(ring, 0, sizeof(*ring));
+  ring->records = malloc(record_size * size);
+  if (!ring->records)
+    return -1;
+  ring->record_size = record_size;
+  ring->mask = size - 1;
+  return 0;
+}
+
+void spsc_free(SpscRing *ring) {
+  free(ring->records);
+  ring->records = NULL;
+}
+
+int spsc_push(SpscRing *ring, const void *record) {
+  unsigned int tail = ring->tail;
+  unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  unsigned int depth = tail - head;
+  if (depth > ring->mask)
+    return 0;
+  memcpy(ring->records + (size_t)(tail & ring->mask) * ring->record_size,
+         record, ring->record_size);
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  if (depth + 1 > ring->high_water)
+    __atomic_store_n(&ring->high_water, depth + 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+int spsc_pop(SpscRing *ring, void *record) {
+  unsigned int head = ring->head;
+  if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+    return 0;
+  memcpy(record,
+         ring->records + (size_t)(head & ring->mask) * ring->record_size,
+         ring->record_size);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+unsigned int spsc_capacity(const SpscRing *ring) { return ring->mask + 1; }
+
+unsigned int spsc_high_water(const SpscRing *ring) {
+  return __atomic_load_n(&ring->high_water, __ATOMIC_RELAXED);
+}
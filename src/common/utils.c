@@ -86,6 +86,11 @@ void build_pidfile_path(char *buffer, size_t buflen) {
   safe_snprintf(buffer, buflen, "%s/vbx-%d.pid", rd, (int)getuid());
 }
 
+void build_stats_path(char *buffer, size_t buflen) {
+  safe_snprintf(buffer, buflen, "%s/vbx-stats-%d.json", get_runtime_dir(),
+                (int)getuid());
+}
+
 int read_pidfile(const char *path, pid_t *out_pid) {
   FILE *f = fopen(path, "r");
   if (!f)
@@ -142,6 +147,15 @@ char *xstrdup(const char *s) {
   return p;
 }
 
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
 // Validate and clamp volume to 0-100 range
 int validate_volume(int volume) {
   if (volume < 0) return 0;
@@ -1,3 +1,4 @@
+#include "common/realtime.h"
 #include "common/utils.h"
 #include "user_config.h"
 #include <errno.h>
@@ -22,7 +23,19 @@ int write_user_config(const char *path, const char *keyboard_sound,
                       const char *mouse_sound, int keyboard_volume,
                       int mouse_volume, int keyboard_enabled,
                       int mouse_enabled) {
-  json_object *root = json_object_new_object();
+  // Start from the existing file so sections vbx does not manage itself,
+  // such as "audio", survive a rewrite
+  json_object *root = json_object_from_file(path);
+  if (root && !json_object_is_type(root, json_type_object)) {
+    json_object_put(root);
+    root = NULL;
+  }
+  if (root) {
+    json_object_object_del(root, "sound");
+    json_object_object_del(root, "volume");
+  } else {
+    root = json_object_new_object();
+  }
   if (!root)
     return 0;
 
@@ -139,3 +152,41 @@ int read_user_config(const char *path, char **out_keyboard_sound,
   json_object_put(root);
   return 1;
 }
+
+// The same clamping as vbx-audio's settings, so both processes agree
+static int clamp_int(int value, int min, int max) {
+  return value < min ? min : value > max ? max : value;
+}
+
+int read_realtime_config(const char *path, int *out_priority, int *out_cpu) {
+  json_object *root = json_object_from_file(path);
+  if (!root)
+    return 0;
+  json_object *audio, *realtime, *o;
+  int enabled = 0;
+  if (json_object_object_get_ex(root, "audio", &audio) &&
+      json_object_object_get_ex(audio, "realtime", &realtime)) {
+    if (json_object_object_get_ex(realtime, "enabled", &o))
+      enabled = json_object_get_boolean(o);
+    if (json_object_object_get_ex(realtime, "priority", &o))
+      *out_priority = clamp_int(json_object_get_int(o), REALTIME_MIN_PRIORITY,
+                                REALTIME_MAX_PRIORITY);
+    if (json_object_object_get_ex(realtime, "input_cpu", &o))
+      *out_cpu = clamp_int(json_object_get_int(o), -1, REALTIME_MAX_CPU);
+  }
+  json_object_put(root);
+  return enabled;
+}
+
+int read_single_process_config(const char *path) {
+  json_object *root = json_object_from_file(path);
+  if (!root)
+    return 0;
+  json_object *audio, *o;
+  int single = 0;
+  if (json_object_object_get_ex(root, "audio", &audio) &&
+      json_object_object_get_ex(audio, "single_process", &o))
+    single = json_object_get_boolean(o);
+  json_object_put(root);
+  return single;
+}
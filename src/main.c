@@ -1,8 +1,10 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include "app/cli.h"
+#include "app/pack_build.h"
 #include "app/process.h"
 #include "app/reload.h"
+#include "app/stats.h"
 #include "app/watch.h"
 #include "common/mute.h"
 #include "common/utils.h"
@@ -57,6 +59,8 @@ static char current_mouse_sound_dir[MAX_PATH_LENGTH] = {0};
 static int current_mute = 0;
 
 int main(int argc, char *argv[]) {
+  if (argc >= 2 && strcmp(argv[1], "pack") == 0)
+    return run_pack_command(argc - 1, argv + 1);
   char *sound_name = strdup("eg-oreo");
   char *mouse_sound_name = strdup("ping");
   int sound_name_owned = 1;
@@ -136,6 +140,16 @@ int main(int argc, char *argv[]) {
     }
     return rc;
   }
+  if (cli_opts.stats_flag) {
+    int rc = print_engine_stats(cli_opts.json_flag);
+    if (sound_name_owned) {
+      free(sound_name);
+    }
+    if (mouse_sound_name_owned) {
+      free(mouse_sound_name);
+    }
+    return rc;
+  }
 
   // Show welcome message for first-time users
   if (access(user_cfg_path, F_OK) != 0 && !flag_daemon) {